@@ -0,0 +1,888 @@
+// Benchmarks and checks of the analyses of d2_brainstorm.cpp, built here
+// without dyno so that they can run anywhere Boost is installed.
+//
+// Build and run:
+//      g++ -std=c++11 -O2 -pthread d2_benchmark.cpp -o d2_benchmark
+//      ./d2_benchmark [name [size]]
+//
+// Everything runs at its default sizes without arguments. Given a name, only
+// that benchmark runs, at the given size if any:
+//  segments N      segmentation graph built from N fork/join events
+//  goodlock N      goodlock on a synthetic trace of N locks
+//  recording N     lock-heavy loop of N iterations per thread, with and
+//                  without recording into ./d2_benchmark.traces
+//  streaming N     streaming_analysis of 16 traces of about 4N events each,
+//                  written to ./d2_benchmark.streaming, under memory limits
+//  online N        online detection checked against the batch analysis,
+//                  and its overhead on the loop of `recording N`
+//  clocks N        happens_before_clocks against plain vector clocks, on
+//                  flat and binary tree fork/join programs of N threads
+//
+// A check that fails prints a line starting with FAILED and makes the exit
+// status non-zero.
+#define D2_NO_DYNO
+#include "d2_brainstorm.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+int failures = 0;
+
+void check(bool ok, char const* what) {
+    if (!ok) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+}
+
+double megabytes(std::size_t bytes) { return bytes / 1048576.0; }
+
+// Plays `events` random start and join events, with thread 0 running first
+// and at most max_alive threads running at once, on anything with the
+// interface of segmentation_graph.
+template <typename Graph>
+void random_fork_join(Graph& graph, std::size_t events,
+                      std::size_t max_alive, std::mt19937& rng) {
+    std::vector<std::size_t> alive(1, 0);
+    std::size_t next = 1;
+    graph.current(0);
+    for (std::size_t e = 0; e < events; ++e) {
+        if (alive.size() < 2 || (alive.size() < max_alive && rng() % 2)) {
+            graph.fork(alive[rng() % alive.size()], next);
+            alive.push_back(next++);
+            continue;
+        }
+        std::size_t const parent = rng() % alive.size();
+        std::size_t child = rng() % (alive.size() - 1);
+        child += child >= parent;
+        graph.join(alive[parent], alive[child]);
+        alive[child] = alive.back();
+        alive.pop_back();
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// segmentation_graph
+//////////////////////////////////////////////////////////////////////////
+// happens_before against the transitive closure of small random programs.
+void check_segments() {
+    std::mt19937 rng(1);
+    std::size_t queries = 0, mismatches = 0;
+    for (int program = 0; program < 200; ++program) {
+        d2::segmentation_graph graph;
+        random_fork_join(graph, 60, 64, rng);
+        std::size_t const n = graph.size();
+        std::vector<std::vector<bool> > reaches(n, std::vector<bool>(n));
+        for (std::size_t v = 0; v < n; ++v) {
+            std::pair<d2::segmentation_graph::segment const*,
+                      d2::segmentation_graph::segment const*> const
+                                            p = graph.predecessors(v);
+            for (d2::segmentation_graph::segment const* u = p.first;
+                                                    u != p.second; ++u)
+                for (std::size_t w = 0; w < n; ++w)
+                    if (w == *u || reaches[w][*u])
+                        reaches[w][v] = true;
+        }
+        for (std::size_t u = 0; u < n; ++u)
+            for (std::size_t v = 0; v < n; ++v, ++queries)
+                mismatches += graph.happens_before(u, v) != reaches[u][v];
+    }
+    std::printf("segments: %zu queries against the transitive closure, "
+                "%zu mismatches\n", queries, mismatches);
+    check(mismatches == 0, "segmentation_graph::happens_before");
+}
+
+void bench_segments(std::size_t size) {
+    check_segments();
+    std::vector<std::size_t> sizes;
+    if (size != 0)
+        sizes.push_back(size);
+    else {
+        sizes.push_back(1000000);
+        sizes.push_back(10000000);
+    }
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        std::mt19937 rng(2);
+        d2::segmentation_graph graph;
+        std::chrono::steady_clock::time_point start =
+                                        std::chrono::steady_clock::now();
+        random_fork_join(graph, sizes[i], 64, rng);
+        double const build = seconds_since(start);
+
+        // Pairs at most 1000 segments apart, about half of them ordered.
+        std::size_t const queries = 100000;
+        std::size_t ordered = 0;
+        start = std::chrono::steady_clock::now();
+        for (std::size_t q = 0; q < queries; ++q) {
+            std::uint32_t const v = rng() % graph.size();
+            std::uint32_t const u = v > 1000 ? v - 1 - rng() % 1000 : 0;
+            ordered += graph.happens_before(u, v);
+        }
+        double const query = seconds_since(start);
+
+        std::printf("segments: %zu events, %zu segments, %zu edges: "
+                    "build %.2f s (%.1f ns/event), %.1f MB "
+                    "(%.1f bytes/segment), query %.2f us (%zu%% ordered)\n",
+                    sizes[i], graph.size(), graph.edges(), build,
+                    build * 1e9 / sizes[i], megabytes(graph.memory()),
+                    double(graph.memory()) / graph.size(),
+                    query * 1e6 / queries, ordered * 100 / queries);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// goodlock
+//////////////////////////////////////////////////////////////////////////
+// Has each thread of `threads` take the locks of one list in order, and
+// returns the number of potential deadlocks found.
+std::size_t deadlocks_of(
+        std::vector<std::vector<std::uintptr_t> > const& threads) {
+    d2::lock_graph graph;
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+        for (std::size_t i = 0; i < threads[t].size(); ++i)
+            graph.acquire(t, threads[t][i]);
+        for (std::size_t i = threads[t].size(); i-- != 0; )
+            graph.release(t, threads[t][i]);
+    }
+    return d2::find_potential_deadlocks(graph).size();
+}
+
+std::vector<std::uintptr_t> locks(std::uintptr_t a, std::uintptr_t b) {
+    std::vector<std::uintptr_t> l(1, a);
+    l.push_back(b);
+    return l;
+}
+
+std::vector<std::uintptr_t> locks(std::uintptr_t a, std::uintptr_t b,
+                                  std::uintptr_t c) {
+    std::vector<std::uintptr_t> l = locks(a, b);
+    l.push_back(c);
+    return l;
+}
+
+void check_goodlock() {
+    std::vector<std::vector<std::uintptr_t> > abba;
+    abba.push_back(locks(10, 20));
+    abba.push_back(locks(20, 10));
+    check(deadlocks_of(abba) == 1, "goodlock finds ABBA");
+
+    std::vector<std::vector<std::uintptr_t> > gated;
+    gated.push_back(locks(5, 10, 20));
+    gated.push_back(locks(5, 20, 10));
+    check(deadlocks_of(gated) == 0, "goodlock drops gated cycles");
+
+    // The same thread can't deadlock with itself.
+    d2::lock_graph same;
+    same.acquire(1, 10); same.acquire(1, 20);
+    same.release(1, 20); same.release(1, 10);
+    same.acquire(1, 20); same.acquire(1, 10);
+    same.release(1, 10); same.release(1, 20);
+    check(d2::find_potential_deadlocks(same).empty(),
+          "goodlock needs distinct threads");
+
+    std::vector<std::vector<std::uintptr_t> > three;
+    for (std::uintptr_t t = 0; t < 3; ++t)
+        three.push_back(locks(100 + t, 100 + (t + 1) % 3));
+    check(deadlocks_of(three) == 1, "goodlock finds a three-lock cycle");
+}
+
+// Each thread takes two locks of a random group of 8 in increasing order,
+// except for rare inversions, which make small strongly connected
+// components all over the graph.
+void bench_goodlock(std::size_t size) {
+    check_goodlock();
+    std::vector<std::size_t> sizes;
+    if (size != 0)
+        sizes.push_back(size);
+    else {
+        sizes.push_back(100000);
+        sizes.push_back(300000);
+    }
+    // At least 4 threads, to check the parallel search even on one core.
+    std::size_t const parallel =
+        std::max(4u, std::thread::hardware_concurrency());
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        std::size_t const groups = std::max<std::size_t>(1, sizes[i] / 8);
+        std::mt19937 rng(3);
+        d2::lock_graph graph;
+        std::size_t events = 0;
+        std::chrono::steady_clock::time_point start =
+                                        std::chrono::steady_clock::now();
+        for (std::size_t n = 0; n < 4 * sizes[i]; ++n) {
+            std::size_t const thread = rng() % 64;
+            std::uintptr_t const base = rng() % groups * 8;
+            std::uintptr_t a = base + rng() % 8, b = base + rng() % 8;
+            if (a == b)
+                continue;
+            if ((a > b) != (rng() % 200 == 0))
+                std::swap(a, b);
+            graph.acquire(thread, a);
+            graph.acquire(thread, b);
+            graph.release(thread, b);
+            graph.release(thread, a);
+            events += 4;
+        }
+        double const build = seconds_since(start);
+        std::printf("goodlock: %zu locks, %zu events, %zu edges: "
+                    "build %.2f s, %.1f MB\n", graph.locks().size(), events,
+                    graph.edges().size(), build, megabytes(graph.memory()));
+
+        std::size_t found = 0;
+        for (std::size_t threads = 1; threads <= parallel;
+                                      threads *= parallel) {
+            start = std::chrono::steady_clock::now();
+            std::size_t const deadlocks =
+                d2::find_potential_deadlocks(graph, threads, 4).size();
+            std::printf("goodlock:   %zu threads: %.3f s, "
+                        "%zu potential deadlocks\n",
+                        threads, seconds_since(start), deadlocks);
+            if (threads == 1)
+                found = deadlocks;
+            else
+                check(deadlocks == found,
+                      "goodlock finds the same deadlocks in parallel");
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// recorder
+//////////////////////////////////////////////////////////////////////////
+// Nanoseconds per iteration of `threads` threads each taking two of 8
+// shared mutexes, nested, `iterations` times.
+template <typename Mutex, typename Thread>
+double lock_heavy(std::size_t threads, std::size_t iterations) {
+    Mutex mutexes[8];
+    std::chrono::steady_clock::time_point const start =
+                                        std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<Thread> > workers;
+    for (std::size_t t = 0; t < threads; ++t)
+        workers.emplace_back(new Thread([&mutexes, t, iterations] {
+            for (std::size_t i = 0; i < iterations; ++i) {
+                Mutex& a = mutexes[(i + t) % 8];
+                Mutex& b = mutexes[(i + t + 1 + t % 2) % 8];
+                a.lock();
+                b.lock();
+                b.unlock();
+                a.unlock();
+            }
+        }));
+    for (std::size_t t = 0; t < threads; ++t)
+        workers[t]->join();
+    return seconds_since(start) * 1e9 / (threads * iterations);
+}
+
+// With one CPU, the threads of lock_heavy get preempted inside their
+// critical sections, so anything making those longer also makes the
+// others block on the mutexes more often; the single thread run shows the
+// cost of recording itself.
+void bench_recording(std::size_t size) {
+    std::size_t const iterations = size != 0 ? size : 1000000;
+    std::string const directory = "d2_benchmark.traces";
+    mkdir(directory.c_str(), 0777);
+    d2::recorder::flusher& recorder = d2::recorder::flusher::instance();
+
+    for (std::size_t threads = 1; threads <= 4; threads *= 4) {
+        double const plain = lock_heavy<std::mutex, std::thread>(
+                                                    threads, iterations);
+        double const off = lock_heavy<WrappedMutex, WrappedThread>(
+                                                    threads, iterations);
+
+        recorder.start("");
+        double const nowhere = lock_heavy<WrappedMutex, WrappedThread>(
+                                                    threads, iterations);
+        recorder.stop();
+
+        // Only touched by the background thread until stop() returns.
+        std::size_t events = 0;
+        std::set<std::uint64_t> traces;
+        recorder.start(directory, [&](d2::recorded_event const* first,
+                                      d2::recorded_event const* last) {
+            events += last - first;
+            traces.insert(first->thread);
+        });
+        double const on = lock_heavy<WrappedMutex, WrappedThread>(
+                                                    threads, iterations);
+        recorder.stop();
+        for (std::set<std::uint64_t>::iterator it = traces.begin();
+                                            it != traces.end(); ++it)
+            std::remove((directory + "/" + std::to_string(*it) +
+                         ".trace").c_str());
+
+        std::printf("recording: %zu threads, ns/iteration: std::mutex %.1f, "
+                    "wrappers not recording %.1f, recording nowhere %.1f "
+                    "(x%.2f), to files %.1f (x%.2f)\n",
+                    threads, plain, off, nowhere, nowhere / plain, on,
+                    on / plain);
+        // Every lock and unlock, plus the start and join of every thread.
+        check(events == threads * (4 * iterations + 2),
+              "every event is recorded");
+    }
+    rmdir(directory.c_str());
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// streaming_analysis
+//////////////////////////////////////////////////////////////////////////
+// Writes the traces of 16 threads, the first starting the others, which
+// take two locks of a random group of 8 of 200k locks `iterations` times,
+// with rare inversions and a few short-lived threads. Returns the paths of
+// the traces and sets bytes to their total size.
+std::vector<std::string> write_traces(std::string const& directory,
+                                      std::size_t iterations,
+                                      std::size_t& bytes) {
+    std::size_t const threads = 16, groups = 200000 / 8;
+    std::vector<std::string> paths;
+    std::vector<std::FILE*> files;
+    for (std::size_t t = 0; t < threads; ++t) {
+        paths.push_back(directory + "/" + std::to_string(t) + ".trace");
+        files.push_back(std::fopen(paths[t].c_str(), "wb"));
+    }
+    std::uint64_t timestamp = 0;
+    auto const put = [&](std::size_t thread, std::uint32_t kind,
+                         std::uint64_t object) {
+        d2::recorded_event const e = { timestamp++, thread, object, kind, 0 };
+        std::fwrite(&e, sizeof e, 1, files[thread]);
+    };
+
+    std::mt19937 rng(4);
+    std::uint64_t next_thread = threads;
+    for (std::size_t t = 1; t < threads; ++t)
+        put(0, d2::recorded_event::thread_start, t);
+    for (std::size_t i = 0; i < iterations; ++i)
+        for (std::size_t t = 1; t < threads; ++t) {
+            std::uint64_t const base = rng() % groups * 8;
+            std::uint64_t a = base + rng() % 8, b = base + rng() % 8;
+            if (a == b)
+                b = base + (b + 1) % 8;
+            if ((a > b) != (rng() % 500 == 0))
+                std::swap(a, b);
+            put(t, d2::recorded_event::lock_acquire, a);
+            put(t, d2::recorded_event::lock_acquire, b);
+            put(t, d2::recorded_event::lock_release, b);
+            put(t, d2::recorded_event::lock_release, a);
+            if (rng() % 100 == 0) {
+                put(t, d2::recorded_event::thread_start, next_thread);
+                put(t, d2::recorded_event::thread_join, next_thread++);
+            }
+        }
+    for (std::size_t t = 1; t < threads; ++t)
+        put(0, d2::recorded_event::thread_join, t);
+    for (std::size_t t = 0; t < threads; ++t)
+        std::fclose(files[t]);
+    bytes = timestamp * sizeof(d2::recorded_event);
+    return paths;
+}
+
+void bench_streaming(std::size_t size) {
+    std::string const directory = "d2_benchmark.streaming";
+    mkdir(directory.c_str(), 0777);
+    std::size_t bytes;
+    std::vector<std::string> const traces =
+        write_traces(directory, size != 0 ? size : 100000, bytes);
+    std::printf("streaming: %zu traces, %.0f MB\n",
+                traces.size(), megabytes(bytes));
+
+    std::size_t const limits[] = { 0, 1 << 20, 4 << 20, 16 << 20 };
+    std::size_t unlimited = 0;
+    for (std::size_t i = 0; i < sizeof limits / sizeof *limits; ++i) {
+        d2::streaming_analysis::options options;
+        options.memory_limit = limits[i];
+        options.spill_directory = directory;
+        d2::streaming_analysis analysis(options);
+        std::chrono::steady_clock::time_point const start =
+                                        std::chrono::steady_clock::now();
+        bool const ok = analysis.run(traces);
+        double const feed = seconds_since(start);
+        std::size_t const memory = analysis.memory();
+        std::size_t const deadlocks = analysis.deadlocks().size();
+        std::printf("streaming:   limit %4.0f MB: %zu spills, %.1f MB after "
+                    "the feed, fed at %.0f MB/s, %.2f s in all, %zu "
+                    "potential deadlocks\n", megabytes(limits[i]),
+                    analysis.spills(), megabytes(memory),
+                    megabytes(bytes) / feed, seconds_since(start), deadlocks);
+        check(ok, "streaming_analysis reads the traces");
+        if (limits[i] == 0)
+            unlimited = deadlocks;
+        else
+            check(deadlocks == unlimited,
+                  "streaming_analysis finds the same deadlocks when spilling");
+    }
+
+    for (std::size_t t = 0; t < traces.size(); ++t)
+        std::remove(traces[t].c_str());
+    std::remove((directory + "/segments.spill").c_str());
+    rmdir(directory.c_str());
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// online_deadlock_detector
+//////////////////////////////////////////////////////////////////////////
+typedef std::vector<d2::lock_graph::lock_id> lock_cycle;
+
+// The locks of d, starting from the smallest one.
+lock_cycle locks_of(d2::potential_deadlock const& d) {
+    lock_cycle locks;
+    for (std::size_t i = 0; i < d.cycle.size(); ++i)
+        locks.push_back(d.cycle[i].from);
+    std::rotate(locks.begin(), std::min_element(locks.begin(), locks.end()),
+                locks.end());
+    return locks;
+}
+
+// Feeds the same acquisitions to a lock_graph and an incremental_lock_graph
+// and compares the cycles found at the end with those reported on the way.
+class online_against_batch {
+public:
+    online_against_batch() : online_(4), duplicates_(0) { }
+
+    void acquire(std::size_t thread, std::uintptr_t lock) {
+        batch_.acquire(thread, lock);
+        online_.acquire(thread, lock, [this](d2::potential_deadlock const& d) {
+            duplicates_ += !reported_.insert(locks_of(d)).second;
+        });
+    }
+
+    void release(std::size_t thread, std::uintptr_t lock) {
+        batch_.release(thread, lock);
+        online_.release(thread, lock);
+    }
+
+    // thread takes `to` while holding `from`.
+    void edge(std::size_t thread, std::uintptr_t from, std::uintptr_t to) {
+        acquire(thread, from);
+        acquire(thread, to);
+        release(thread, to);
+        release(thread, from);
+    }
+
+    // The number of cycles found by both, or -1 if they differ.
+    long compare() const {
+        std::vector<d2::potential_deadlock> const found =
+                            d2::find_potential_deadlocks(batch_, 1, 4);
+        std::set<lock_cycle> batch;
+        for (std::size_t i = 0; i < found.size(); ++i)
+            batch.insert(locks_of(found[i]));
+        if (duplicates_ != 0 || batch != reported_)
+            return -1;
+        return static_cast<long>(batch.size());
+    }
+
+private:
+    d2::lock_graph batch_;
+    d2::incremental_lock_graph online_;
+    std::set<lock_cycle> reported_;
+    std::size_t duplicates_;
+};
+
+void check_online() {
+    // Merging {0, 1, 5} when 5 -> 0 comes must not move 4 below 3, or the
+    // cycle closed by 4 -> 3 is missed.
+    online_against_batch merge;
+    for (std::uintptr_t l = 0; l < 6; ++l)
+        merge.edge(100, l, l); // gives the locks ids in order
+    merge.edge(10, 0, 1);
+    merge.edge(11, 1, 2);
+    merge.edge(12, 2, 4);
+    merge.edge(0, 3, 4);
+    merge.edge(13, 0, 5);
+    merge.edge(14, 1, 5);
+    merge.edge(15, 5, 0);
+    merge.edge(3, 4, 3);
+    check(merge.compare() >= 0, "online detection reorders merged locks");
+
+    std::mt19937 rng(5);
+    std::size_t cycles = 0, mismatches = 0;
+    for (int trace = 0; trace < 1000; ++trace) {
+        std::size_t const locks = 3 + rng() % 30, threads = 2 + rng() % 6;
+        std::size_t const steps = 50 + rng() % 500;
+        online_against_batch graphs;
+        std::vector<std::vector<std::uintptr_t> > held(threads);
+        for (std::size_t s = 0; s < steps; ++s) {
+            std::size_t const t = rng() % threads;
+            if (!held[t].empty() && (rng() % 3 == 0 || held[t].size() >= 3)) {
+                std::size_t const i = rng() % held[t].size();
+                graphs.release(t, held[t][i]);
+                held[t].erase(held[t].begin() + i);
+                continue;
+            }
+            std::uintptr_t const l = rng() % locks;
+            if (std::find(held[t].begin(), held[t].end(), l) != held[t].end())
+                continue;
+            graphs.acquire(t, l);
+            held[t].push_back(l);
+        }
+        long const found = graphs.compare();
+        if (found < 0)
+            ++mismatches;
+        else
+            cycles += found;
+    }
+    std::printf("online: 1000 random traces, %zu cycles, %zu traces "
+                "differing from find_potential_deadlocks\n",
+                cycles, mismatches);
+    check(mismatches == 0, "online detection finds the batch cycles");
+}
+
+// A lock that any thread can release, so that a deadlock on it can be
+// broken from the outside.
+class releasable_mutex {
+public:
+    releasable_mutex() : locked_(false) { }
+
+    void lock() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this] { return !locked_; });
+        locked_ = true;
+    }
+
+    void unlock() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            locked_ = false;
+        }
+        released_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    bool locked_;
+};
+
+// Two threads really deadlock on two locks, each blocked in lock(): the
+// deadlock must be reported while they are blocked.
+void check_blocked() {
+    std::atomic<bool> found(false);
+    d2::online_deadlock_detector detector(
+        [&found](d2::potential_deadlock const&) { found = true; });
+    d2::recorder::flusher::instance().start("", std::ref(detector),
+                                            std::chrono::milliseconds(2));
+
+    mutex_wrapper<releasable_mutex> a, b;
+    std::atomic<int> holding(0);
+    auto const take = [&holding](mutex_wrapper<releasable_mutex>& first,
+                                 mutex_wrapper<releasable_mutex>& second) {
+        first.lock();
+        ++holding;
+        while (holding != 2)
+            std::this_thread::yield();
+        second.lock();
+        second.unlock();
+        first.unlock();
+    };
+    std::thread t1(take, std::ref(a), std::ref(b));
+    std::thread t2(take, std::ref(b), std::ref(a));
+
+    std::chrono::steady_clock::time_point const start =
+                                        std::chrono::steady_clock::now();
+    while (!found && seconds_since(start) < 2)
+        std::this_thread::yield();
+    bool const reported = found;
+    double const latency = seconds_since(start);
+    // Let t2 through, which then lets t1 through.
+    a.releasable_mutex::unlock();
+    t1.join();
+    t2.join();
+    d2::recorder::flusher::instance().stop();
+
+    std::printf("online: ABBA deadlock %s while blocked, after %.1f ms\n",
+                reported ? "reported" : "not reported", latency * 1e3);
+    check(reported, "online detection reports a deadlock while blocked");
+}
+
+void bench_online(std::size_t size) {
+    check_online();
+    check_blocked();
+
+    std::size_t const iterations = size != 0 ? size : 1000000;
+    d2::recorder::flusher& recorder = d2::recorder::flusher::instance();
+    for (std::size_t threads = 1; threads <= 4; threads *= 4) {
+        double const plain = lock_heavy<std::mutex, std::thread>(
+                                                    threads, iterations);
+        d2::online_deadlock_detector detector(
+                                    [](d2::potential_deadlock const&) { });
+        recorder.start("", std::ref(detector), std::chrono::milliseconds(2));
+        double const online = lock_heavy<WrappedMutex, WrappedThread>(
+                                                    threads, iterations);
+        recorder.stop();
+        std::printf("online: %zu threads, ns/iteration: std::mutex %.1f, "
+                    "online detection %.1f (x%.2f)\n",
+                    threads, plain, online, online / plain);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// happens_before_clocks
+//////////////////////////////////////////////////////////////////////////
+// A full vector clock per segment, with the interface of
+// happens_before_clocks, to compare it with.
+class plain_vector_clocks {
+public:
+    typedef d2::segmentation_graph::segment segment;
+    typedef d2::segmentation_graph::thread_id thread_id;
+
+    segment current(thread_id thread) {
+        std::unordered_map<thread_id, std::uint32_t>::iterator it =
+                                                    threads_.find(thread);
+        if (it != threads_.end())
+            return current_[it->second];
+        std::uint32_t const c = new_clock();
+        threads_.insert(std::make_pair(thread, c));
+        return new_segment(c);
+    }
+
+    void fork(thread_id parent, thread_id child) {
+        current(parent);
+        std::uint32_t const p = threads_[parent];
+        std::uint32_t const c = new_clock();
+        threads_[child] = c;
+        clocks_[c] = clocks_[p];
+        new_segment(p);
+        new_segment(c);
+    }
+
+    void join(thread_id parent, thread_id child) {
+        current(parent);
+        current(child);
+        std::uint32_t const p = threads_[parent], c = threads_[child];
+        std::vector<std::uint32_t>& into = clocks_[p];
+        std::vector<std::uint32_t> const& from = clocks_[c];
+        if (into.size() < from.size())
+            into.resize(from.size(), 0);
+        for (std::size_t i = 0; i < from.size(); ++i)
+            into[i] = std::max(into[i], from[i]);
+        new_segment(p);
+        threads_.erase(child);
+    }
+
+    bool happens_before(segment u, segment v) const {
+        if (u >= v)
+            return false;
+        std::vector<std::uint32_t> const& clock = snapshots_[v];
+        return stamps_[u].first < clock.size() &&
+               clock[stamps_[u].first] >= stamps_[u].second;
+    }
+
+    std::size_t size() const { return snapshots_.size(); }
+
+    std::size_t memory() const {
+        std::size_t bytes = stamps_.capacity() * sizeof(stamps_[0]);
+        for (std::size_t i = 0; i < snapshots_.size(); ++i)
+            bytes += snapshots_[i].capacity() * sizeof(std::uint32_t);
+        for (std::size_t i = 0; i < clocks_.size(); ++i)
+            bytes += clocks_[i].capacity() * sizeof(std::uint32_t);
+        return bytes;
+    }
+
+private:
+    std::uint32_t new_clock() {
+        clocks_.push_back(std::vector<std::uint32_t>());
+        current_.push_back(0);
+        return static_cast<std::uint32_t>(clocks_.size() - 1);
+    }
+
+    segment new_segment(std::uint32_t c) {
+        std::vector<std::uint32_t>& clock = clocks_[c];
+        if (clock.size() <= c)
+            clock.resize(c + 1, 0);
+        stamps_.push_back(std::make_pair(c, ++clock[c]));
+        snapshots_.push_back(clock);
+        return current_[c] = static_cast<segment>(snapshots_.size() - 1);
+    }
+
+    std::vector<std::vector<std::uint32_t> > clocks_, snapshots_;
+    std::vector<std::pair<std::uint32_t, std::uint32_t> > stamps_;
+    std::vector<segment> current_;
+    std::unordered_map<thread_id, std::uint32_t> threads_;
+};
+
+// Every segment pair of random fork/join programs, in which any thread may
+// join any other one.
+void check_clocks() {
+    std::mt19937 rng(7);
+    std::size_t queries = 0, mismatches = 0;
+    for (int program = 0; program < 400; ++program) {
+        d2::segmentation_graph graph;
+        d2::happens_before_clocks clocks;
+        plain_vector_clocks plain;
+        std::vector<std::size_t> alive(1, 0);
+        std::size_t next = 1;
+        graph.current(0);
+        clocks.current(0);
+        plain.current(0);
+        for (std::size_t steps = 5 + rng() % 60; steps != 0; --steps) {
+            if (alive.size() > 1 && rng() % 2) {
+                std::size_t const parent = alive[rng() % alive.size()];
+                std::size_t child;
+                do
+                    child = alive[rng() % alive.size()];
+                while (child == parent);
+                graph.join(parent, child);
+                clocks.join(parent, child);
+                plain.join(parent, child);
+                alive.erase(std::find(alive.begin(), alive.end(), child));
+            }
+            else {
+                std::size_t const parent = alive[rng() % alive.size()];
+                graph.fork(parent, next);
+                clocks.fork(parent, next);
+                plain.fork(parent, next);
+                alive.push_back(next++);
+            }
+        }
+        check(clocks.size() == graph.size() && plain.size() == graph.size(),
+              "vector clocks number segments like the graph");
+        for (std::uint32_t u = 0; u < graph.size(); ++u)
+            for (std::uint32_t v = 0; v < graph.size(); ++v, ++queries) {
+                bool const ordered = graph.happens_before(u, v);
+                mismatches += clocks.happens_before(u, v) != ordered ||
+                              plain.happens_before(u, v) != ordered;
+            }
+    }
+    std::printf("clocks: %zu queries against segmentation_graph, "
+                "%zu mismatches\n", queries, mismatches);
+    check(mismatches == 0, "happens_before_clocks::happens_before");
+}
+
+// Thread 0 forks `threads` threads, then joins them all.
+template <typename Clocks>
+void flat_fork_join(Clocks& clocks, std::size_t threads) {
+    clocks.current(0);
+    for (std::size_t t = 1; t <= threads; ++t)
+        clocks.fork(0, t);
+    for (std::size_t t = 1; t <= threads; ++t)
+        clocks.join(0, t);
+}
+
+// A binary tree of `threads` threads, each forking its two children and
+// joining them.
+template <typename Clocks>
+void tree_fork_join(Clocks& clocks, std::size_t thread, std::size_t threads) {
+    clocks.current(thread);
+    if (threads <= 1)
+        return;
+    std::size_t const left = 2 * thread + 1, right = 2 * thread + 2;
+    clocks.fork(thread, left);
+    clocks.fork(thread, right);
+    tree_fork_join(clocks, left, threads / 2);
+    tree_fork_join(clocks, right, threads - threads / 2 - 1);
+    clocks.join(thread, left);
+    clocks.join(thread, right);
+}
+
+template <typename Clocks>
+double build(Clocks& clocks, bool tree, std::size_t threads) {
+    std::chrono::steady_clock::time_point const start =
+                                        std::chrono::steady_clock::now();
+    if (tree)
+        tree_fork_join(clocks, 0, threads);
+    else
+        flat_fork_join(clocks, threads);
+    return seconds_since(start);
+}
+
+template <typename Clocks>
+double query(Clocks const& clocks,
+             std::vector<std::pair<std::uint32_t, std::uint32_t> > const& q,
+             std::vector<bool>& answers) {
+    answers.resize(q.size());
+    std::chrono::steady_clock::time_point const start =
+                                        std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < q.size(); ++i)
+        answers[i] = clocks.happens_before(q[i].first, q[i].second);
+    return seconds_since(start) * 1e9 / q.size();
+}
+
+void bench_clocks(std::size_t size) {
+    check_clocks();
+    std::vector<std::size_t> sizes;
+    if (size != 0)
+        sizes.push_back(size);
+    else {
+        sizes.push_back(1000);
+        sizes.push_back(10000);
+    }
+    for (int tree = 0; tree < 2; ++tree)
+        for (std::size_t i = 0; i < sizes.size(); ++i) {
+            d2::happens_before_clocks clocks;
+            plain_vector_clocks plain;
+            double const clocks_build = build(clocks, tree, sizes[i]);
+            double const plain_build = build(plain, tree, sizes[i]);
+
+            std::mt19937 rng(8);
+            std::vector<std::pair<std::uint32_t, std::uint32_t> > q;
+            for (std::size_t n = 0; n < 200000; ++n) {
+                std::uint32_t const a = rng() % clocks.size();
+                std::uint32_t const b = rng() % clocks.size();
+                q.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+            std::vector<bool> clocks_answers, plain_answers;
+            double const clocks_query = query(clocks, q, clocks_answers);
+            double const plain_query = query(plain, q, plain_answers);
+
+            std::printf("clocks: %s, %zu threads, %zu segments: compressed "
+                        "build %.1f ms, %.1f MB, query %.0f ns; plain build "
+                        "%.1f ms, %.1f MB, query %.0f ns\n",
+                        tree ? "binary tree" : "flat", sizes[i],
+                        clocks.size(), clocks_build * 1e3,
+                        megabytes(clocks.memory()), clocks_query,
+                        plain_build * 1e3, megabytes(plain.memory()),
+                        plain_query);
+            check(clocks_answers == plain_answers,
+                  "compressed and plain vector clocks agree");
+        }
+}
+
+struct benchmark {
+    char const* name;
+    void (*run)(std::size_t size);
+};
+
+benchmark const benchmarks[] = {
+    { "segments", bench_segments },
+    { "goodlock", bench_goodlock },
+    { "recording", bench_recording },
+    { "streaming", bench_streaming },
+    { "online", bench_online },
+    { "clocks", bench_clocks }
+};
+} // end anonymous namespace
+
+int main(int argc, char** argv) {
+    std::string const only = argc > 1 ? argv[1] : "";
+    std::size_t const size = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 0;
+    bool ran = false;
+    for (std::size_t i = 0; i < sizeof benchmarks / sizeof *benchmarks; ++i)
+        if (only.empty() || only == benchmarks[i].name) {
+            benchmarks[i].run(size);
+            ran = true;
+        }
+    if (!ran)
+        std::printf("unknown benchmark %s\n", only.c_str());
+    return ran && failures == 0 ? 0 : 1;
+}
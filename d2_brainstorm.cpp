@@ -1,15 +1,34 @@
 
+#include <boost/assert.hpp>
 #include <boost/config.hpp>
 #include <boost/graph/directed_graph.hpp>
 #include <boost/proto/proto.hpp>
+#ifndef D2_NO_DYNO
 #include <dyno/model/easy_map.hpp>
 #include <dyno/v2/dyno.hpp>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <queue>
 #include <set>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 
 namespace d2 {
@@ -31,48 +50,1915 @@ template <typename Level> struct join { typedef thread_sync_domain dyno_domain;
 // semantics: segment still running but no one will wait for it to complete before the end of the execution
 template <typename Level> struct detach { typedef thread_sync_domain dyno_domain; };
 
+// semantics: current segment acquires/releases a lock
+struct acquire { typedef thread_sync_domain dyno_domain; };
+struct release { typedef thread_sync_domain dyno_domain; };
+
+
+//////////////////////////////////////////////////////////////////////////
+// segmentation_graph.hpp
+//////////////////////////////////////////////////////////////////////////
+// Graph of the code segments of an execution, where an edge u -> v means
+// that u completes before v begins.
+//
+// Segments are numbered in the order they are created and every edge goes
+// from an older segment to a newer one. Hence, the predecessors of a segment
+// are all known when it is created and can simply be appended to a
+// compressed sparse row layout, and segment ids are a topological order.
+class segmentation_graph {
+public:
+    typedef std::uint32_t segment;
+    typedef std::size_t thread_id;
+
+    segmentation_graph()
+        : offsets_(1, 0), spilled_(0), spilled_edges_(0), epoch_(0)
+    { }
+
+    // Adds a segment that begins after the segments in [first, last)
+    // complete.
+    segment add_segment(segment const* first, segment const* last) {
+        BOOST_ASSERT(size() < static_cast<segment>(-1));
+        BOOST_ASSERT(sources_.size() + (last - first) <=
+                     static_cast<std::uint32_t>(-1));
+        segment const s = static_cast<segment>(size());
+        for (; first != last; ++first) {
+            BOOST_ASSERT(*first < s);
+            sources_.push_back(*first);
+        }
+        offsets_.push_back(static_cast<std::uint32_t>(sources_.size()));
+        return s;
+    }
+
+    // Segment currently executed by thread, which gets a first segment
+    // without predecessors if it was not seen before.
+    segment current(thread_id thread) {
+        std::unordered_map<thread_id, segment>::iterator it =
+                                                    current_.find(thread);
+        if (it == current_.end())
+            it = current_.insert(std::make_pair(thread,
+                                       add_segment(NULL, NULL))).first;
+        return it->second;
+    }
+
+    // parent starts child: the current segment of parent completes before
+    // both the rest of parent and child begin.
+    void fork(thread_id parent, thread_id child) {
+        segment const before = current(parent);
+        current_[parent] = add_segment(&before, &before + 1);
+        current_[child] = add_segment(&before, &before + 1);
+    }
+
+    // parent joins child: the rest of parent begins after the current
+    // segments of both threads complete.
+    void join(thread_id parent, thread_id child) {
+        segment const before[2] = { current(parent), current(child) };
+        current_[parent] = add_segment(before, before + 2);
+        current_.erase(child);
+    }
+
+    std::size_t size() const { return spilled_ + offsets_.size() - 1; }
+    std::size_t edges() const { return spilled_edges_ + sources_.size(); }
+
+    // Segments below spilled() were written out by spill() and can't be
+    // looked at anymore.
+    std::size_t spilled() const { return spilled_; }
+
+    std::pair<segment const*, segment const*> predecessors(segment s) const {
+        BOOST_ASSERT(s >= spilled_ && s < size());
+        segment const* base = sources_.data();
+        s -= spilled_;
+        return std::make_pair(base + offsets_[s], base + offsets_[s + 1]);
+    }
+
+    // Whether u completes before v begins, i.e. whether there is a path
+    // from u to v. Since predecessors have smaller ids, the search goes
+    // backward from v and never looks at segments older than u.
+    //
+    // This uses scratch space in the graph, so queries must not be made
+    // concurrently.
+    bool happens_before(segment u, segment v) const {
+        BOOST_ASSERT(u >= spilled_ && u < size() && v < size());
+        if (u >= v)
+            return false;
+
+        if (marks_.size() < size() - spilled_)
+            marks_.resize(size() - spilled_, 0);
+        if (++epoch_ == 0) {
+            std::fill(marks_.begin(), marks_.end(), 0);
+            epoch_ = 1;
+        }
+
+        stack_.clear();
+        stack_.push_back(v);
+        while (!stack_.empty()) {
+            segment const s = stack_.back() - spilled_;
+            stack_.pop_back();
+            for (std::uint32_t e = offsets_[s]; e != offsets_[s + 1]; ++e) {
+                segment const p = sources_[e];
+                if (p == u)
+                    return true;
+                if (p > u && marks_[p - spilled_] != epoch_) {
+                    marks_[p - spilled_] = epoch_;
+                    stack_.push_back(p);
+                }
+            }
+        }
+        return false;
+    }
+
+    void reserve(std::size_t segments, std::size_t edges) {
+        offsets_.reserve(segments + 1);
+        sources_.reserve(edges);
+    }
+
+    // Appends the segments held in memory to f and forgets them, keeping
+    // only the current segment of each thread. Each call writes one block:
+    // the id of its first segment, the number of segments n and of edges,
+    // then n + 1 offsets and the sources, all as 32-bit integers.
+    bool spill(std::FILE* f) {
+        std::uint32_t const header[3] = {
+            static_cast<std::uint32_t>(spilled_),
+            static_cast<std::uint32_t>(offsets_.size() - 1),
+            static_cast<std::uint32_t>(sources_.size())
+        };
+        if (std::fwrite(header, sizeof header, 1, f) != 1 ||
+            std::fwrite(offsets_.data(), sizeof(std::uint32_t),
+                        offsets_.size(), f) != offsets_.size() ||
+            std::fwrite(sources_.data(), sizeof(segment),
+                        sources_.size(), f) != sources_.size())
+            return false;
+        spilled_ += offsets_.size() - 1;
+        spilled_edges_ += sources_.size();
+        std::vector<std::uint32_t>(1, 0).swap(offsets_);
+        std::vector<segment>().swap(sources_);
+        std::vector<std::uint32_t>().swap(marks_);
+        return true;
+    }
+
+    // Bytes allocated for the graph itself, leaving out the scratch space
+    // of happens_before.
+    std::size_t memory() const {
+        return offsets_.capacity() * sizeof(std::uint32_t) +
+               sources_.capacity() * sizeof(segment) +
+               current_.size() * (sizeof(thread_id) + sizeof(segment));
+    }
+
+private:
+    std::vector<std::uint32_t> offsets_;
+    std::vector<segment> sources_;
+    std::unordered_map<thread_id, segment> current_;
+    std::size_t spilled_;
+    std::size_t spilled_edges_;
+
+    mutable std::vector<std::uint32_t> marks_;
+    mutable std::uint32_t epoch_;
+    mutable std::vector<segment> stack_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// happens_before_clocks.hpp
+//////////////////////////////////////////////////////////////////////////
+// Answers the happens_before queries of a segmentation_graph fed the same
+// events (segments are numbered the same way) with a few lookups instead
+// of a graph search, using vector clocks compressed for fork/join programs.
+//
+// Each thread has a clock whose own entry goes up by one with every new
+// segment of the thread, and each segment is stamped with its thread and
+// that entry. u happens before v when v's thread knew, at v's time, a time
+// of u's thread at least as recent as u's.
+//
+// Storing a full vector clock per segment would take O(threads) space per
+// segment. Instead, clocks are never copied:
+//  - a forked thread inherits the clock of its parent as it was at the
+//    fork, by pointing to it;
+//  - a thread records the entries that a join increases, and only those,
+//    as dated updates.
+// Reading an entry of a clock at some time looks at the updates of the
+// thread, then at those of its parent at the time of the fork, and so on.
+// Joining a thread only merges what it learned since its fork, plus what
+// its ancestors knew if the joining thread did not know it already, so the
+// work done by a join is proportional to the number of entries it changes.
+// When threads are joined by their parent, that is O(1) per fork and join
+// for a flat fork/join program and O(depth) for nested ones.
+class happens_before_clocks {
+public:
+    typedef segmentation_graph::segment segment;
+    typedef segmentation_graph::thread_id thread_id;
+
+    happens_before_clocks() : epoch_(0) { }
+
+    // Same as segmentation_graph::current.
+    segment current(thread_id thread) {
+        std::unordered_map<thread_id, clock_id>::iterator it =
+                                                    threads_.find(thread);
+        if (it != threads_.end())
+            return clocks_[it->second].current;
+        clock_id const c = new_clock(none, 0);
+        threads_.insert(std::make_pair(thread, c));
+        return new_segment(c);
+    }
+
+    // Same as segmentation_graph::fork.
+    void fork(thread_id parent, thread_id child) {
+        current(parent);
+        clock_id const p = threads_[parent];
+        tick const forked_at = clocks_[p].now;
+        new_segment(p);
+        clock_id const c = new_clock(p, forked_at);
+        threads_[child] = c;
+        new_segment(c);
+    }
+
+    // Same as segmentation_graph::join.
+    void join(thread_id parent, thread_id child) {
+        current(parent);
+        current(child);
+        clock_id const p = threads_[parent];
+        tick const before = clocks_[p].now;
+        new_segment(p);
+        if (++epoch_ == 0) {
+            std::fill(seen_.begin(), seen_.end(), 0);
+            epoch_ = 1;
+        }
+
+        // Walk up the ancestry of child until reaching something parent
+        // already knew; newer updates come first, so the first value seen
+        // for an entry is the largest.
+        clock_id c = threads_[child];
+        for (tick t = clocks_[c].now; c != none && get(p, before, c) < t;
+                            t = clocks_[c].forked_at, c = clocks_[c].parent) {
+            learn(p, before, c, t);
+            for (std::uint32_t u = clocks_[c].updates; u != none;
+                                        u = updates_[u].previous_in_clock)
+                if (updates_[u].at <= t)
+                    learn(p, before, updates_[u].of, updates_[u].value);
+        }
+        threads_.erase(child);
+    }
+
+    // Same as segmentation_graph::happens_before.
+    bool happens_before(segment u, segment v) const {
+        BOOST_ASSERT(u < size() && v < size());
+        if (u >= v)
+            return false;
+        stamp const& su = stamps_[u];
+        stamp const& sv = stamps_[v];
+        return get(sv.clock, sv.time, su.clock) >= su.time;
+    }
+
+    std::size_t size() const { return stamps_.size(); }
+    std::size_t updates() const { return updates_.size(); }
+
+    // Rough number of bytes used, counting the hash tables at one node per
+    // element.
+    std::size_t memory() const {
+        std::size_t const node = 2 * sizeof(void*);
+        return stamps_.capacity() * sizeof(stamp) +
+               clocks_.capacity() * sizeof(clock) +
+               updates_.capacity() * sizeof(update) +
+               seen_.capacity() * sizeof(std::uint32_t) +
+               latest_.size() * (sizeof(std::uint64_t) + 4 + node) +
+               latest_.bucket_count() * sizeof(void*) +
+               threads_.size() * (sizeof(thread_id) + 4 + node) +
+               threads_.bucket_count() * sizeof(void*);
+    }
+
+private:
+    typedef std::uint32_t clock_id;
+    typedef std::uint32_t tick;
+    static std::uint32_t const none = static_cast<std::uint32_t>(-1);
+
+    struct stamp {
+        clock_id clock;
+        tick time;
+    };
+
+    // Ticks start at 1, so 0 stands for a thread not known at all.
+    struct clock {
+        clock_id parent;
+        tick forked_at;
+        tick now;
+        segment current;
+        std::uint32_t updates;  // newest first, through previous_in_clock
+    };
+
+    // Entry `of` of a clock is `value` from time `at` of that clock on.
+    struct update {
+        tick at;
+        tick value;
+        clock_id of;
+        std::uint32_t previous;  // older update of the same entry
+        std::uint32_t previous_in_clock;
+    };
+
+    static std::uint64_t key(clock_id c, clock_id of) {
+        return static_cast<std::uint64_t>(c) << 32 | of;
+    }
+
+    clock_id new_clock(clock_id parent, tick forked_at) {
+        BOOST_ASSERT(clocks_.size() < none);
+        clock const c = { parent, forked_at, 0, 0, none };
+        clocks_.push_back(c);
+        seen_.push_back(0);
+        return static_cast<clock_id>(clocks_.size() - 1);
+    }
+
+    segment new_segment(clock_id c) {
+        BOOST_ASSERT(stamps_.size() < static_cast<segment>(-1));
+        stamp const s = { c, ++clocks_[c].now };
+        stamps_.push_back(s);
+        return clocks_[c].current = static_cast<segment>(stamps_.size() - 1);
+    }
+
+    // Entry `of` of clock c at time t.
+    tick get(clock_id c, tick t, clock_id of) const {
+        for (; c != none; t = clocks_[c].forked_at, c = clocks_[c].parent) {
+            if (c == of)
+                return t;
+            std::unordered_map<std::uint64_t, std::uint32_t>::const_iterator
+                                            it = latest_.find(key(c, of));
+            if (it == latest_.end())
+                continue;
+            for (std::uint32_t u = it->second; u != none;
+                                                u = updates_[u].previous)
+                if (updates_[u].at <= t)
+                    return updates_[u].value;
+        }
+        return 0;
+    }
+
+    // Raises entry `of` of clock p to value for p's new segment, if it was
+    // below that before it.
+    void learn(clock_id p, tick before, clock_id of, tick value) {
+        if (seen_[of] == epoch_ || of == p)
+            return;
+        seen_[of] = epoch_;
+        if (get(p, before, of) >= value)
+            return;
+        BOOST_ASSERT(updates_.size() < none);
+        std::uint32_t const u = static_cast<std::uint32_t>(updates_.size());
+        std::pair<std::unordered_map<std::uint64_t, std::uint32_t>::iterator,
+                  bool> const r = latest_.insert(std::make_pair(key(p, of), u));
+        update const added = { clocks_[p].now, value, of,
+                               r.second ? none : r.first->second,
+                               clocks_[p].updates };
+        r.first->second = u;
+        clocks_[p].updates = u;
+        updates_.push_back(added);
+    }
+
+    std::vector<stamp> stamps_;
+    std::vector<clock> clocks_;
+    std::vector<update> updates_;
+    // Newest update of each entry of each clock.
+    std::unordered_map<std::uint64_t, std::uint32_t> latest_;
+    std::unordered_map<thread_id, clock_id> threads_;
+
+    // Entries already merged by the current join.
+    std::vector<std::uint32_t> seen_;
+    std::uint32_t epoch_;
+};
+
 
 //////////////////////////////////////////////////////////////////////////
 // build_segmentation_graph.hpp
 //////////////////////////////////////////////////////////////////////////
+// The Environment of these events must provide the ids of the two threads
+// involved as `env.parent` and `env.child`.
 struct build_segmentation_graph {
+    explicit build_segmentation_graph(segmentation_graph& graph)
+        : graph_(graph)
+    { }
+
     template <typename Environment>
-    void operator()(start<parallelism_level<thread> >, Environment const&) const
-    { std::cout << "start<parallelism_level<thread> >" << std::endl; }
+    void operator()(start<parallelism_level<thread> >, Environment const& env) const
+    { graph_.fork(env.parent, env.child); }
 
     template <typename Environment>
-    void operator()(join<parallelism_level<thread> >, Environment const&) const
-    { std::cout << "join<parallelism_level<thread> >" << std::endl; }
+    void operator()(join<parallelism_level<thread> >, Environment const& env) const
+    { graph_.join(env.parent, env.child); }
 
+    // Nobody waits for a detached thread, so there is nothing to record: it
+    // keeps running in its current segment until the end of the execution.
     template <typename Environment>
     void operator()(detach<parallelism_level<thread> >, Environment const&) const
-    { std::cout << "detach<parallelism_level<thread> >" << std::endl; }
+    { }
+
+private:
+    segmentation_graph& graph_;
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////
+// lock_graph.hpp
+//////////////////////////////////////////////////////////////////////////
+// Dense integer ids for the locks seen in a trace, which are identified by
+// whatever integer the recorder uses (typically their address).
+class lock_ids {
+public:
+    typedef std::uint32_t lock_id;
+
+    lock_id operator()(std::uintptr_t lock) {
+        std::unordered_map<std::uintptr_t, lock_id>::iterator it =
+                                                        ids_.find(lock);
+        if (it != ids_.end())
+            return it->second;
+        BOOST_ASSERT(locks_.size() < static_cast<lock_id>(-1));
+        lock_id const id = static_cast<lock_id>(locks_.size());
+        ids_.insert(std::make_pair(lock, id));
+        locks_.push_back(lock);
+        return id;
+    }
+
+    std::uintptr_t lock(lock_id id) const { return locks_[id]; }
+    std::size_t size() const { return locks_.size(); }
+
+private:
+    std::unordered_map<std::uintptr_t, lock_id> ids_;
+    std::vector<std::uintptr_t> locks_;
 };
 
+// The lock-order graph of goodlock: an edge l1 -> l2 labelled (t, G) means
+// that thread t acquired l2 while holding l1, and G is the set of locks
+// (the gate locks) it was holding at that moment, l1 included. Identical
+// edges are only recorded once, and gate sets are interned.
+class lock_graph {
+public:
+    typedef lock_ids::lock_id lock_id;
+    typedef std::size_t thread_id;
+    typedef std::uint32_t gate_set;
+
+    struct edge {
+        lock_id from, to;
+        thread_id thread;
+        gate_set gates;
+    };
+
+    void acquire(thread_id thread, std::uintptr_t lock) {
+        lock_id const l = ids_(lock);
+        held_locks& held = held_[thread];
+        // Reacquiring a recursive lock does not order anything.
+        if (std::find(held.locks.begin(), held.locks.end(), l) ==
+                                                    held.locks.end() &&
+            !held.locks.empty()) {
+            while (held.gates.size() < held.locks.size())
+                held.gates.push_back(prefix(held, held.gates.size()));
+            gate_set const gates = held.gates.back();
+            for (std::size_t i = 0; i < held.locks.size(); ++i) {
+                edge const e = { held.locks[i], l, thread, gates };
+                if (seen_.insert(e).second)
+                    edges_.push_back(e);
+            }
+        }
+        held.locks.push_back(l);
+    }
+
+    void release(thread_id thread, std::uintptr_t lock) {
+        lock_id const l = ids_(lock);
+        held_locks& held = held_[thread];
+        std::vector<lock_id>::reverse_iterator it =
+                        std::find(held.locks.rbegin(), held.locks.rend(), l);
+        BOOST_ASSERT(it != held.locks.rend());
+        std::size_t const i = held.locks.rend() - it - 1;
+        held.locks.erase(held.locks.begin() + i);
+        if (held.gates.size() > i)
+            held.gates.resize(i);
+    }
+
+    std::vector<edge> const& edges() const { return edges_; }
+    lock_ids const& locks() const { return ids_; }
+
+    // Moves the edges recorded so far to out, keeping the lock ids, the gate
+    // sets and the locks held by each thread so recording can go on. Edges
+    // recorded afterwards may repeat the ones handed out.
+    void take_edges(std::vector<edge>& out) {
+        out.clear();
+        out.swap(edges_);
+        std::vector<edge>().swap(edges_);
+        std::unordered_set<edge, hash_edge, same_edge>().swap(seen_);
+    }
+
+    // Adds back an edge handed out by take_edges. The caller is responsible
+    // for not adding the same edge twice.
+    void restore_edge(edge const& e) { edges_.push_back(e); }
+
+    // Rough number of bytes used, counting the hash tables at one node per
+    // element.
+    std::size_t memory() const {
+        std::size_t const node = 2 * sizeof(void*);
+        std::size_t gates = 0;
+        for (std::size_t i = 0; i < gate_sets_.size(); ++i)
+            gates += 2 * gate_sets_[i].capacity() * sizeof(lock_id) + node;
+        return edges_.capacity() * sizeof(edge) +
+               seen_.size() * (sizeof(edge) + node) +
+               seen_.bucket_count() * sizeof(void*) +
+               ids_.size() * (sizeof(std::uintptr_t) * 2 + node) + gates +
+               extended_.capacity() * sizeof(extended_[0]);
+    }
+
+    // Sorted locks of a gate set.
+    std::vector<lock_id> const& gates(gate_set g) const {
+        return gate_sets_[g];
+    }
+
+private:
+    struct hash_locks {
+        std::size_t operator()(std::vector<lock_id> const& locks) const {
+            std::size_t h = locks.size();
+            for (std::size_t i = 0; i < locks.size(); ++i)
+                h = h * 1000003u ^ locks[i];
+            return h;
+        }
+    };
+
+    struct hash_edge {
+        std::size_t operator()(edge const& e) const {
+            std::size_t h = e.from;
+            h = h * 1000003u ^ e.to;
+            h = h * 1000003u ^ e.thread;
+            return h * 1000003u ^ e.gates;
+        }
+    };
+
+    struct same_edge {
+        bool operator()(edge const& a, edge const& b) const {
+            return a.from == b.from && a.to == b.to &&
+                   a.thread == b.thread && a.gates == b.gates;
+        }
+    };
+
+    // The locks held by a thread, in the order they were taken, and the
+    // gate set made of each of their prefixes, computed when another lock
+    // is taken while holding it. The gate sets are found through a small
+    // cache first, so that taking locks the same way as recently only costs
+    // a lookup, without sorting or hashing the locks held.
+    struct held_locks {
+        std::vector<lock_id> locks;
+        std::vector<gate_set> gates;
+    };
+
+    static gate_set const no_gates = static_cast<gate_set>(-1);
+
+    // The gate set made of the locks held up to the i-th one, knowing
+    // those up to the previous one.
+    gate_set prefix(held_locks const& held, std::size_t i) {
+        if (i == 0)
+            return extend(no_gates, held.locks[0]);
+        return extend(held.gates[i - 1], held.locks[i]);
+    }
+
+    // The gate set made of g and l.
+    gate_set extend(gate_set g, lock_id l) {
+        std::uint64_t const key = static_cast<std::uint64_t>(g) << 32 | l;
+        if (extended_.empty())
+            extended_.assign(extended_cache_size,
+                             std::make_pair(static_cast<std::uint64_t>(-1),
+                                            gate_set()));
+        std::pair<std::uint64_t, gate_set>& cached =
+            extended_[(key * 0x9E3779B97F4A7C15ull) >> 52];
+        if (cached.first == key)
+            return cached.second;
+        if (g == no_gates)
+            scratch_.clear();
+        else
+            scratch_ = gate_sets_[g];
+        std::vector<lock_id>::iterator const at =
+                    std::lower_bound(scratch_.begin(), scratch_.end(), l);
+        if (at == scratch_.end() || *at != l)
+            scratch_.insert(at, l);
+        cached.first = key;
+        return cached.second = intern(scratch_);
+    }
+
+    // Takes sorted locks.
+    gate_set intern(std::vector<lock_id> const& locks) {
+        std::pair<std::unordered_map<std::vector<lock_id>, gate_set,
+                                     hash_locks>::iterator, bool> const r =
+            gate_ids_.insert(std::make_pair(locks,
+                                    static_cast<gate_set>(gate_sets_.size())));
+        if (r.second)
+            gate_sets_.push_back(locks);
+        return r.first->second;
+    }
+
+    lock_ids ids_;
+    std::unordered_map<thread_id, held_locks> held_;
+    std::vector<edge> edges_;
+    std::unordered_set<edge, hash_edge, same_edge> seen_;
+    std::unordered_map<std::vector<lock_id>, gate_set, hash_locks> gate_ids_;
+    std::vector<std::vector<lock_id> > gate_sets_;
+    // Gate sets made of another one and a lock, direct mapped.
+    static std::size_t const extended_cache_size = 1 << 12;
+    std::vector<std::pair<std::uint64_t, gate_set> > extended_;
+    std::vector<lock_id> scratch_;
+};
 
 
 //////////////////////////////////////////////////////////////////////////
-// analysis.hpp
+// goodlock_analysis.hpp
 //////////////////////////////////////////////////////////////////////////
+// The Environment of these events must provide the id of the current thread
+// as `env.thread` and the lock as `env.lock`.
+struct goodlock_analysis {
+    explicit goodlock_analysis(lock_graph& graph)
+        : graph_(graph)
+    { }
+
+    template <typename Environment>
+    void operator()(acquire, Environment const& env) const
+    { graph_.acquire(env.thread, env.lock); }
+
+    template <typename Environment>
+    void operator()(release, Environment const& env) const
+    { graph_.release(env.thread, env.lock); }
+
+private:
+    lock_graph& graph_;
+};
+
+// A cycle l1 -> l2 -> ... -> l1 in the lock graph whose edges come from
+// distinct threads and have pairwise disjoint gate sets, i.e. a sequence
+// of acquisitions that could deadlock if the threads interleaved badly.
+struct potential_deadlock {
+    std::vector<lock_graph::edge> cycle;
+};
+
+namespace goodlock_detail {
+    typedef lock_graph::lock_id lock_id;
+    typedef lock_graph::edge edge;
+
+    // Edges grouped by source lock: out(l) is [first[l], first[l + 1]).
+    struct adjacency {
+        std::vector<std::uint32_t> first;
+        std::vector<edge> edges;
+
+        adjacency(std::vector<edge> const& all, std::size_t locks)
+            : first(locks + 1, 0), edges(all.size())
+        {
+            for (std::size_t i = 0; i < all.size(); ++i)
+                ++first[all[i].from + 1];
+            for (std::size_t l = 0; l < locks; ++l)
+                first[l + 1] += first[l];
+            std::vector<std::uint32_t> next(first.begin(), first.end() - 1);
+            for (std::size_t i = 0; i < all.size(); ++i)
+                edges[next[all[i].from]++] = all[i];
+            // Parallel edges (same locks, other labels) next to each other.
+            for (std::size_t l = 0; l < locks; ++l)
+                std::sort(edges.begin() + first[l],
+                          edges.begin() + first[l + 1],
+                          [](edge const& a, edge const& b) {
+                              return a.to < b.to;
+                          });
+        }
+    };
+
+    // Iterative Tarjan; returns the component of each lock and the number
+    // of components.
+    inline std::size_t
+    strong_components(adjacency const& g,
+                      std::vector<std::uint32_t>& component) {
+        std::size_t const n = g.first.size() - 1;
+        std::uint32_t const unvisited = static_cast<std::uint32_t>(-1);
+        std::vector<std::uint32_t> index(n, unvisited), low(n);
+        std::vector<lock_id> stack;
+        std::vector<bool> on_stack(n, false);
+        std::vector<std::pair<lock_id, std::uint32_t> > calls;
+        component.assign(n, unvisited);
+        std::uint32_t counter = 0, components = 0;
+
+        for (lock_id root = 0; root < n; ++root) {
+            if (index[root] != unvisited)
+                continue;
+            calls.push_back(std::make_pair(root, g.first[root]));
+            index[root] = low[root] = counter++;
+            stack.push_back(root);
+            on_stack[root] = true;
+            while (!calls.empty()) {
+                lock_id const v = calls.back().first;
+                std::uint32_t& e = calls.back().second;
+                if (e != g.first[v + 1]) {
+                    lock_id const w = g.edges[e++].to;
+                    if (index[w] == unvisited) {
+                        index[w] = low[w] = counter++;
+                        stack.push_back(w);
+                        on_stack[w] = true;
+                        calls.push_back(std::make_pair(w, g.first[w]));
+                    }
+                    else if (on_stack[w])
+                        low[v] = std::min(low[v], index[w]);
+                    continue;
+                }
+                if (low[v] == index[v]) {
+                    lock_id w;
+                    do {
+                        w = stack.back();
+                        stack.pop_back();
+                        on_stack[w] = false;
+                        component[w] = components;
+                    } while (w != v);
+                    ++components;
+                }
+                calls.pop_back();
+                if (!calls.empty()) {
+                    lock_id const parent = calls.back().first;
+                    low[parent] = std::min(low[parent], low[v]);
+                }
+            }
+        }
+        return components;
+    }
+
+    inline bool disjoint(std::vector<lock_id> const& a,
+                         std::vector<lock_id> const& b) {
+        std::size_t i = 0, j = 0;
+        while (i < a.size() && j < b.size()) {
+            if (a[i] == b[j])
+                return false;
+            a[i] < b[j] ? ++i : ++j;
+        }
+        return true;
+    }
+
+    // Enumerates the simple cycles of one strongly connected component and
+    // keeps those that have a valid labelling. Every cycle is found once,
+    // starting from its smallest lock.
+    class cycle_finder {
+    public:
+        cycle_finder(lock_graph const& graph, adjacency const& g,
+                     std::vector<std::uint32_t> const& component,
+                     std::size_t max_length,
+                     std::vector<potential_deadlock>& out)
+            : graph_(graph), g_(g), component_(component),
+              max_length_(max_length), out_(out)
+        { }
+
+        void run(std::vector<lock_id> const& locks) {
+            for (std::size_t i = 0; i < locks.size(); ++i) {
+                start_ = locks[i];
+                path_.assign(1, start_);
+                extend(start_);
+            }
+        }
+
+    private:
+        void extend(lock_id l) {
+            for (std::uint32_t e = g_.first[l]; e != g_.first[l + 1]; ) {
+                lock_id const next = g_.edges[e].to;
+                std::uint32_t end = e;
+                while (end != g_.first[l + 1] && g_.edges[end].to == next)
+                    ++end;
+                hops_.push_back(std::make_pair(e, end));
+                e = end;
+
+                if (next == start_ && path_.size() > 1)
+                    label(0);
+                else if (next > start_ && path_.size() < max_length_ &&
+                         component_[next] == component_[start_] &&
+                         std::find(path_.begin(), path_.end(), next) ==
+                            path_.end()) {
+                    path_.push_back(next);
+                    extend(next);
+                    path_.pop_back();
+                }
+                hops_.pop_back();
+            }
+        }
+
+        // Picks an edge for every hop of the cycle in hops_, backtracking
+        // until one labelling is valid.
+        bool label(std::size_t hop) {
+            if (hop == hops_.size()) {
+                potential_deadlock d;
+                for (std::size_t i = 0; i < chosen_.size(); ++i)
+                    d.cycle.push_back(g_.edges[chosen_[i]]);
+                out_.push_back(d);
+                return true;
+            }
+            for (std::uint32_t e = hops_[hop].first; e != hops_[hop].second;
+                                                                       ++e) {
+                edge const& candidate = g_.edges[e];
+                bool ok = true;
+                for (std::size_t i = 0; ok && i < chosen_.size(); ++i) {
+                    edge const& other = g_.edges[chosen_[i]];
+                    ok = other.thread != candidate.thread &&
+                         disjoint(graph_.gates(other.gates),
+                                  graph_.gates(candidate.gates));
+                }
+                if (!ok)
+                    continue;
+                chosen_.push_back(e);
+                bool const found = label(hop + 1);
+                chosen_.pop_back();
+                if (found)
+                    return true;
+            }
+            return false;
+        }
+
+        lock_graph const& graph_;
+        adjacency const& g_;
+        std::vector<std::uint32_t> const& component_;
+        std::size_t max_length_;
+        std::vector<potential_deadlock>& out_;
+
+        lock_id start_;
+        std::vector<lock_id> path_;
+        std::vector<std::pair<std::uint32_t, std::uint32_t> > hops_;
+        std::vector<std::uint32_t> chosen_;
+    };
+} // end namespace goodlock_detail
+
+// Finds the potential deadlocks involving at most max_length locks. Cycles
+// can only occur within a strongly connected component of the lock graph,
+// so the components are searched independently by up to `threads` threads,
+// largest first.
+inline std::vector<potential_deadlock>
+find_potential_deadlocks(lock_graph const& graph, std::size_t threads = 1,
+                         std::size_t max_length = 4) {
+    using namespace goodlock_detail;
+    std::size_t const n = graph.locks().size();
+    adjacency const g(graph.edges(), n);
+    std::vector<std::uint32_t> component;
+    std::size_t const components = strong_components(g, component);
+
+    std::vector<std::vector<lock_id> > members(components);
+    for (lock_id l = 0; l < n; ++l)
+        members[component[l]].push_back(l);
+    std::vector<std::uint32_t> work;
+    for (std::uint32_t c = 0; c < components; ++c)
+        if (members[c].size() > 1)
+            work.push_back(c);
+    std::sort(work.begin(), work.end(),
+              [&](std::uint32_t a, std::uint32_t b) {
+                  return members[a].size() > members[b].size();
+              });
+
+    threads = std::max<std::size_t>(1, std::min(threads, work.size()));
+    std::vector<std::vector<potential_deadlock> > found(threads);
+    std::atomic<std::size_t> next(0);
+    auto worker = [&](std::size_t t) {
+        cycle_finder finder(graph, g, component, max_length, found[t]);
+        for (std::size_t i; (i = next++) < work.size(); )
+            finder.run(members[work[i]]);
+    };
+    std::vector<std::thread> pool;
+    for (std::size_t t = 1; t < threads; ++t)
+        pool.push_back(std::thread(worker, t));
+    worker(0);
+    for (std::size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+
+    std::vector<potential_deadlock> deadlocks;
+    for (std::size_t t = 0; t < threads; ++t)
+        deadlocks.insert(deadlocks.end(), found[t].begin(), found[t].end());
+    return deadlocks;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// recorder.hpp
+//////////////////////////////////////////////////////////////////////////
+// What the wrappers record. `thread` is the recording thread and `object`
+// is the other thread for start/join/detach and the lock otherwise. The
+// timestamp is a clock shared by all threads, so the per-thread traces can
+// be merged back in order; it is left at 0 when no trace is written.
+struct recorded_event {
+    enum kind_type {
+        thread_start, thread_join, thread_detach, lock_acquire, lock_release
+    };
+
+    std::uint64_t timestamp;
+    std::uint64_t thread;
+    std::uint64_t object;
+    std::uint32_t kind;
+    std::uint32_t padding;
+};
+
+namespace recorder {
+    inline std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // Events are recorded into per-thread chunks, which are handed to a
+    // background thread once full and written to `<directory>/<thread>.trace`.
+    // Each recording overwrites the traces of the threads it records.
+    std::size_t const chunk_size = 4096;
+
+    // A chunk is filled by one recording thread, which publishes each event
+    // by storing the new size, while the background thread may hand out the
+    // events published so far; `done` and `seen` are only touched by the
+    // latter.
+    struct chunk {
+        std::uint64_t thread;
+        bool timestamped;
+        std::atomic<std::size_t> size;
+        std::size_t done;
+        std::size_t seen;
+        recorded_event events[chunk_size];
+    };
+
+    class flusher {
+    public:
+        static flusher& instance() {
+            static flusher f;
+            return f;
+        }
+
+        // Called with consecutive events of a single thread.
+        typedef std::function<void (recorded_event const*,
+                                    recorded_event const*)> observer;
+
+        // Starts recording into directory, which must exist, or nowhere if
+        // it is empty. Events are also shown to observe, if any, on the
+        // background thread and in the order of each recording thread.
+        //
+        // Events are normally handed over shortly after their chunk is
+        // full. With max_latency, the background thread also looks at the
+        // chunks being filled every max_latency / 2 (or more often), and
+        // hands over the events it saw the previous time, so events come
+        // through within max_latency even if the recording thread is
+        // blocked.
+        void start(std::string const& directory,
+                   observer const& observe = observer(),
+                   std::chrono::nanoseconds max_latency =
+                                        std::chrono::nanoseconds::max()) {
+            stop();
+            std::lock_guard<std::mutex> lock(mutex_);
+            directory_ = directory;
+            observe_ = observe;
+            max_latency_ = max_latency;
+            stopping_ = false;
+            writer_ = std::thread([this] { run(); });
+            enabled_.store(true, std::memory_order_relaxed);
+        }
+
+        // Stops recording and waits until everything handed over so far is
+        // written. The chunk of the calling thread is handed over first, but
+        // events still buffered by other running threads are lost.
+        void stop();
+
+        bool enabled() const {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        std::uint64_t new_thread_id() {
+            return next_thread_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // An empty chunk for thread, which the background thread may look
+        // at until it is pushed back.
+        chunk* fresh_chunk(std::uint64_t thread) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            chunk* c;
+            if (free_.empty())
+                c = new chunk;
+            else {
+                c = free_.back();
+                free_.pop_back();
+            }
+            c->thread = thread;
+            c->timestamped = !directory_.empty();
+            c->size.store(0, std::memory_order_relaxed);
+            c->done = c->seen = 0;
+            filling_.push_back(c);
+            return c;
+        }
+
+        // The background thread is only woken up once a few chunks are
+        // waiting, and looks for them every check_interval otherwise. Waking
+        // it up for every chunk makes it preempt the recording threads much
+        // more often, possibly while they hold a lock that the others then
+        // queue up for.
+        void push(chunk* c) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                filling_.erase(std::find(filling_.begin(), filling_.end(), c));
+                full_.push_back(c);
+                if (full_.size() < wake_up_after)
+                    return;
+            }
+            ready_.notify_one();
+        }
+
+        // Chunks handed over after stop(), by threads that were still
+        // recording or exited since, are written to the traces here.
+        ~flusher() {
+            stop();
+            observe_ = observer(); // may be gone by now
+            for (std::size_t i = 0; i < full_.size(); ++i) {
+                write(*full_[i], full_[i]->size.load());
+                delete full_[i];
+            }
+            close_files();
+            for (std::size_t i = 0; i < free_.size(); ++i)
+                delete free_[i];
+        }
+
+    private:
+        static std::size_t const wake_up_after = 8;
+
+        static std::chrono::nanoseconds check_interval() {
+            return std::chrono::milliseconds(1);
+        }
+
+        flusher()
+            : stopping_(false), enabled_(false),
+              max_latency_(std::chrono::nanoseconds::max()), next_thread_(0)
+        { }
+
+        // Full chunks are always written before the chunks being filled are
+        // looked at, so the events of each thread come out in order.
+        void run() {
+            bool const poll = max_latency_ != std::chrono::nanoseconds::max();
+            std::chrono::nanoseconds const interval =
+                poll ? std::min(max_latency_ / 2, check_interval())
+                     : check_interval();
+            std::vector<chunk*> filling;
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (;;) {
+                if (!full_.empty()) {
+                    chunk* c = full_.front();
+                    full_.pop_front();
+                    lock.unlock();
+                    write(*c, c->size.load(std::memory_order_acquire));
+                    lock.lock();
+                    free_.push_back(c);
+                    continue;
+                }
+                if (stopping_)
+                    break;
+
+                // Chunks are only recycled by this thread, so they can be
+                // looked at without the lock even if they are pushed.
+                if (poll) {
+                    filling = filling_;
+                    lock.unlock();
+                    for (std::size_t i = 0; i < filling.size(); ++i) {
+                        chunk& c = *filling[i];
+                        std::size_t const size =
+                                    c.size.load(std::memory_order_acquire);
+                        if (c.done < c.seen)
+                            write(c, c.seen);
+                        c.seen = size;
+                    }
+                    lock.lock();
+                }
+                if (full_.empty() && !stopping_)
+                    ready_.wait_for(lock, interval);
+            }
+            close_files();
+        }
+
+        void close_files() {
+            for (std::unordered_map<std::uint64_t, std::FILE*>::iterator
+                    it = files_.begin(); it != files_.end(); ++it)
+                std::fclose(it->second);
+            files_.clear();
+        }
+
+        // Hands out the events of c before `size` not handed out yet. Only
+        // called from the writer thread, or once it is gone.
+        void write(chunk& c, std::size_t size) {
+            recorded_event const* first = c.events + c.done;
+            recorded_event const* last = c.events + size;
+            if (first == last)
+                return;
+            c.done = size;
+            if (observe_)
+                observe_(first, last);
+            if (directory_.empty())
+                return;
+            std::FILE*& f = files_[c.thread];
+            if (f == NULL) {
+                std::string const path =
+                    directory_ + "/" + std::to_string(c.thread) + ".trace";
+                f = std::fopen(path.c_str(), "wb");
+                if (f == NULL)
+                    return;
+            }
+            std::fwrite(first, sizeof *first, last - first, f);
+        }
+
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::deque<chunk*> full_;
+        std::vector<chunk*> filling_;
+        std::vector<chunk*> free_;
+        std::thread writer_;
+        std::string directory_;
+        std::unordered_map<std::uint64_t, std::FILE*> files_;
+        observer observe_;
+        bool stopping_;
+        std::atomic<bool> enabled_;
+        std::chrono::nanoseconds max_latency_;
+        std::atomic<std::uint64_t> next_thread_;
+    };
+
+    // The recording state of a thread. Nothing here is shared: only getting
+    // a chunk or handing it over involves the flusher.
+    struct local_buffer {
+        std::uint64_t thread;
+        bool has_id;
+        chunk* current;
+
+        local_buffer() : thread(0), has_id(false), current(NULL) { }
+        ~local_buffer() { flush(); }
+
+        void record(std::uint32_t kind, std::uint64_t object) {
+            if (current == NULL)
+                refill();
+            std::size_t const size =
+                current->size.load(std::memory_order_relaxed);
+            recorded_event& e = current->events[size];
+            e.timestamp = current->timestamped ? now() : 0;
+            e.thread = thread;
+            e.object = object;
+            e.kind = kind;
+            e.padding = 0;
+            current->size.store(size + 1, std::memory_order_release);
+            if (size + 1 == chunk_size)
+                flush();
+        }
+
+        void flush() {
+            if (current != NULL)
+                flusher::instance().push(current);
+            current = NULL;
+        }
+
+    private:
+        void refill() {
+            if (!has_id) {
+                thread = flusher::instance().new_thread_id();
+                has_id = true;
+            }
+            current = flusher::instance().fresh_chunk(thread);
+        }
+    };
+
+    inline local_buffer& local() {
+        static thread_local local_buffer buffer;
+        return buffer;
+    }
+
+    inline void record(recorded_event::kind_type kind, std::uint64_t object) {
+        if (flusher::instance().enabled())
+            local().record(kind, object);
+    }
+
+    inline void flusher::stop() {
+        if (!enabled_.exchange(false, std::memory_order_relaxed) &&
+            !writer_.joinable())
+            return;
+        local().flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_one();
+        writer_.join();
+    }
+
+    // Called by a thread about to start another one: returns the id of the
+    // new thread and records its start.
+    inline std::uint64_t fork() {
+        std::uint64_t const child = flusher::instance().new_thread_id();
+        record(recorded_event::thread_start, child);
+        return child;
+    }
+
+    // Called first thing by a thread started with fork().
+    inline void adopt(std::uint64_t id) {
+        local_buffer& buffer = local();
+        BOOST_ASSERT(!buffer.has_id);
+        buffer.thread = id;
+        buffer.has_id = true;
+    }
+} // end namespace recorder
+
+
+//////////////////////////////////////////////////////////////////////////
+// streaming_analysis.hpp
+//////////////////////////////////////////////////////////////////////////
+// Reads the recorded_events of a trace file through a fixed size buffer.
+class trace_reader {
+public:
+    trace_reader(std::string const& path, std::size_t buffer_events)
+        : file_(std::fopen(path.c_str(), "rb")), buffer_(buffer_events),
+          position_(0), size_(0)
+    { }
+
+    ~trace_reader() {
+        if (file_ != NULL)
+            std::fclose(file_);
+    }
+
+    bool is_open() const { return file_ != NULL; }
+
+    // The next event, or NULL at the end of the trace.
+    recorded_event const* next() {
+        if (position_ == size_) {
+            if (file_ == NULL)
+                return NULL;
+            size_ = std::fread(buffer_.data(), sizeof(recorded_event),
+                               buffer_.size(), file_);
+            position_ = 0;
+            if (size_ == 0)
+                return NULL;
+        }
+        return &buffer_[position_++];
+    }
+
+    std::size_t memory() const {
+        return buffer_.capacity() * sizeof(recorded_event);
+    }
+
+private:
+    trace_reader(trace_reader const&);
+    trace_reader& operator=(trace_reader const&);
+
+    std::FILE* file_;
+    std::vector<recorded_event> buffer_;
+    std::size_t position_;
+    std::size_t size_;
+};
+
+// Runs the analyses over per-thread traces too large to be loaded at once.
+//
+// The traces are merged by timestamp with a heap holding one event per
+// trace, and each event is fed to the segmentation graph or the lock graph
+// as it comes. When the memory used goes over the limit, the segments built
+// so far are appended to `<spill_directory>/segments.spill` and the lock
+// graph edges are written out as a sorted run. Runs are merged back, without
+// duplicates, when deadlocks are looked for.
+//
+// Some of the state (lock ids, gate sets, the current segment of each
+// thread) can't be spilled, so a spill only happens once at least half the
+// limit was built up since the previous one. Runs are therefore large, at
+// the cost of going over the limit when the state that stays is large too.
+// They are merged at most merge_fan_in at a time, through a heap.
+class streaming_analysis {
+public:
+    struct options {
+        std::size_t memory_limit;   // bytes; 0 means no limit
+        std::string spill_directory;
+        std::size_t buffer_events;  // per trace
+
+        options()
+            : memory_limit(0), spill_directory("."), buffer_events(1 << 14)
+        { }
+    };
+
+    explicit streaming_analysis(options const& opts = options())
+        : options_(opts), events_(0), spills_(0), retained_(0), next_run_(0),
+          segments_file_(NULL)
+    { }
+
+    ~streaming_analysis() {
+        if (segments_file_ != NULL)
+            std::fclose(segments_file_);
+        for (std::size_t i = 0; i < runs_.size(); ++i)
+            std::remove(runs_[i].c_str());
+    }
+
+    // Feeds the events of all the traces, in timestamp order. Returns false
+    // if a trace can't be opened or spilling fails.
+    bool run(std::vector<std::string> const& traces) {
+        std::vector<std::unique_ptr<trace_reader> > readers;
+        typedef std::pair<std::uint64_t, std::size_t> entry;
+        std::priority_queue<entry, std::vector<entry>,
+                            std::greater<entry> > heap;
+        std::vector<recorded_event const*> heads(traces.size());
+        for (std::size_t i = 0; i < traces.size(); ++i) {
+            readers.emplace_back(
+                new trace_reader(traces[i], options_.buffer_events));
+            if (!readers[i]->is_open())
+                return false;
+            if ((heads[i] = readers[i]->next()) != NULL)
+                heap.push(entry(heads[i]->timestamp, i));
+        }
+        std::size_t const buffers = traces.size() * options_.buffer_events *
+                                    sizeof(recorded_event);
+
+        while (!heap.empty()) {
+            std::size_t const i = heap.top().second;
+            heap.pop();
+            feed(*heads[i]);
+            if ((heads[i] = readers[i]->next()) != NULL)
+                heap.push(entry(heads[i]->timestamp, i));
+
+            if (++events_ % check_interval == 0 && options_.memory_limit &&
+                buffers + memory() > options_.memory_limit &&
+                memory() >= retained_ + options_.memory_limit / 2 && !spill())
+                return false;
+        }
+        return true;
+    }
+
+    // Finds the potential deadlocks in everything fed so far; see
+    // find_potential_deadlocks.
+    std::vector<potential_deadlock>
+    deadlocks(std::size_t threads = 1, std::size_t max_length = 4) {
+        if (!runs_.empty() && (!spill_locks() || !merge_runs()))
+            return std::vector<potential_deadlock>();
+        return find_potential_deadlocks(locks_, threads, max_length);
+    }
+
+    segmentation_graph& segments() { return segments_; }
+    lock_graph& locks() { return locks_; }
+
+    std::size_t events() const { return events_; }
+    std::size_t spills() const { return spills_; }
+    std::size_t memory() const { return segments_.memory() + locks_.memory(); }
+
+private:
+    static std::size_t const check_interval = 1 << 16;
+    static std::size_t const merge_fan_in = 16;
+
+    void feed(recorded_event const& e) {
+        switch (e.kind) {
+        case recorded_event::thread_start:
+            segments_.fork(e.thread, e.object);
+            break;
+        case recorded_event::thread_join:
+            segments_.join(e.thread, e.object);
+            break;
+        case recorded_event::thread_detach:
+            break;
+        case recorded_event::lock_acquire:
+            locks_.acquire(e.thread, e.object);
+            break;
+        case recorded_event::lock_release:
+            locks_.release(e.thread, e.object);
+            break;
+        }
+    }
+
+    bool spill() {
+        ++spills_;
+        if (segments_file_ == NULL) {
+            std::string const path =
+                options_.spill_directory + "/segments.spill";
+            segments_file_ = std::fopen(path.c_str(), "wb");
+            if (segments_file_ == NULL)
+                return false;
+        }
+        if (!segments_.spill(segments_file_) || !spill_locks())
+            return false;
+        retained_ = memory();
+        return true;
+    }
+
+    static bool edge_less(lock_graph::edge const& a,
+                          lock_graph::edge const& b) {
+        if (a.from != b.from) return a.from < b.from;
+        if (a.to != b.to) return a.to < b.to;
+        if (a.thread != b.thread) return a.thread < b.thread;
+        return a.gates < b.gates;
+    }
+
+    bool spill_locks() {
+        std::vector<lock_graph::edge> edges;
+        locks_.take_edges(edges);
+        std::sort(edges.begin(), edges.end(), edge_less);
+        std::string const path = run_path();
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (f == NULL)
+            return false;
+        runs_.push_back(path);
+        bool const ok = std::fwrite(edges.data(), sizeof edges[0],
+                                    edges.size(), f) == edges.size();
+        return std::fclose(f) == 0 && ok;
+    }
+
+    std::string run_path() {
+        return options_.spill_directory + "/locks." +
+               std::to_string(next_run_++) + ".spill";
+    }
+
+    // Merges the sorted runs [first, last), dropping duplicates, and hands
+    // each edge to out in order; stops if out returns false.
+    template <typename Out>
+    bool merge(std::size_t first, std::size_t last, Out out) const {
+        typedef lock_graph::edge edge;
+        std::vector<std::unique_ptr<std::FILE, int (*)(std::FILE*)> > files;
+        std::vector<edge> heads(last - first);
+        std::vector<std::size_t> heap; // runs with an edge left, min on top
+        for (std::size_t i = 0; i < heads.size(); ++i) {
+            files.emplace_back(std::fopen(runs_[first + i].c_str(), "rb"),
+                               &std::fclose);
+            if (!files[i])
+                return false;
+            if (std::fread(&heads[i], sizeof(edge), 1, files[i].get()) == 1)
+                heap.push_back(i);
+        }
+        auto const later = [&heads](std::size_t a, std::size_t b) {
+            return edge_less(heads[b], heads[a]);
+        };
+        std::make_heap(heap.begin(), heap.end(), later);
+
+        bool first_edge = true;
+        edge last_edge = edge();
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            std::size_t const i = heap.back();
+            if (first_edge || edge_less(last_edge, heads[i])) {
+                if (!out(heads[i]))
+                    return false;
+                last_edge = heads[i];
+                first_edge = false;
+            }
+            if (std::fread(&heads[i], sizeof(edge), 1, files[i].get()) == 1)
+                std::push_heap(heap.begin(), heap.end(), later);
+            else
+                heap.pop_back();
+        }
+        return true;
+    }
+
+    // Merges the sorted runs back into the lock graph, dropping duplicates.
+    // As long as there are more than merge_fan_in runs, groups of that many
+    // are first merged into a new run each, so that few files are open at
+    // once and each edge is read O(log(runs)) times.
+    bool merge_runs() {
+        typedef lock_graph::edge edge;
+        while (runs_.size() > merge_fan_in) {
+            std::vector<std::string> merged;
+            for (std::size_t first = 0; first < runs_.size();
+                                        first += merge_fan_in) {
+                std::size_t const last =
+                    std::min(first + merge_fan_in, runs_.size());
+                std::string const path = run_path();
+                std::FILE* f = std::fopen(path.c_str(), "wb");
+                bool ok = f != NULL;
+                if (ok) {
+                    merged.push_back(path);
+                    ok = merge(first, last, [f](edge const& e) {
+                        return std::fwrite(&e, sizeof e, 1, f) == 1;
+                    });
+                    ok = std::fclose(f) == 0 && ok;
+                }
+                if (!ok) {
+                    // Keep track of every file left, for the destructor.
+                    merged.insert(merged.end(), runs_.begin() + first,
+                                  runs_.end());
+                    runs_.swap(merged);
+                    return false;
+                }
+                for (std::size_t i = first; i < last; ++i)
+                    std::remove(runs_[i].c_str());
+            }
+            runs_.swap(merged);
+        }
+
+        if (!merge(0, runs_.size(), [this](edge const& e) {
+                locks_.restore_edge(e);
+                return true;
+            }))
+            return false;
+        for (std::size_t i = 0; i < runs_.size(); ++i)
+            std::remove(runs_[i].c_str());
+        runs_.clear();
+        return true;
+    }
+
+    options options_;
+    segmentation_graph segments_;
+    lock_graph locks_;
+    std::size_t events_;
+    std::size_t spills_;
+    std::size_t retained_; // memory() right after the last spill
+    std::size_t next_run_;
+    std::FILE* segments_file_;
+    std::vector<std::string> runs_;
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+// online_analysis.hpp
+//////////////////////////////////////////////////////////////////////////
+// Lock graph that reports the potential deadlocks closed by each new edge
+// as it is added, instead of searching the whole graph at the end.
+//
+// The strongly connected components of the graph are kept in a topological
+// order, maintained as in Pearce and Kelly's dynamic algorithm: an edge
+// going against the order only reorders the components lying between its
+// ends, merging those that now form a cycle. An edge can only be part of a
+// cycle if both its ends are in the same component, and only then are the
+// cycles through it enumerated, within that component.
+class incremental_lock_graph {
+public:
+    typedef lock_graph::lock_id lock_id;
+    typedef lock_graph::thread_id thread_id;
+    typedef lock_graph::edge edge;
+
+    explicit incremental_lock_graph(std::size_t max_length = 4)
+        : max_length_(max_length), epoch_(0)
+    { }
+
+    // Calls report(potential_deadlock const&) for every potential deadlock
+    // of at most max_length locks made possible by this acquisition.
+    template <typename Report>
+    void acquire(thread_id thread, std::uintptr_t lock, Report&& report) {
+        std::size_t const first = locks_.edges().size();
+        locks_.acquire(thread, lock);
+        for (std::size_t e = first; e < locks_.edges().size(); ++e)
+            add(static_cast<std::uint32_t>(e), report);
+    }
+
+    void release(thread_id thread, std::uintptr_t lock) {
+        locks_.release(thread, lock);
+    }
+
+    lock_graph const& locks() const { return locks_; }
+
+private:
+    static std::uint64_t pair(lock_id from, lock_id to) {
+        return static_cast<std::uint64_t>(from) << 32 | to;
+    }
+
+    lock_id find(lock_id l) {
+        while (parent_[l] != l)
+            l = parent_[l] = parent_[parent_[l]];
+        return l;
+    }
+
+    void grow(std::size_t locks) {
+        while (parent_.size() < locks) {
+            lock_id const l = static_cast<lock_id>(parent_.size());
+            parent_.push_back(l);
+            order_.push_back(l);
+            members_.push_back(std::vector<lock_id>(1, l));
+            out_.push_back(std::vector<lock_id>());
+            in_.push_back(std::vector<lock_id>());
+            forward_mark_.push_back(0);
+            backward_mark_.push_back(0);
+        }
+    }
+
+    template <typename Report>
+    void add(std::uint32_t e, Report& report) {
+        edge const added = locks_.edges()[e];
+        grow(std::max(added.from, added.to) + 1u);
+        std::vector<std::uint32_t>& labels =
+                                    labels_[pair(added.from, added.to)];
+        labels.push_back(e);
+        if (labels.size() == 1) {
+            out_[added.from].push_back(added.to);
+            in_[added.to].push_back(added.from);
+            insert(find(added.from), find(added.to));
+        }
+        if (find(added.from) == find(added.to))
+            find_cycles(e, report);
+    }
+
+    // Collects into found the components reachable from c (forward) or
+    // reaching c (backward) whose order is within [lower, upper], marking
+    // them with epoch_.
+    void search(lock_id c, bool forward, std::uint32_t lower,
+                std::uint32_t upper, std::vector<lock_id>& found) {
+        std::vector<std::uint32_t>& mark =
+                                forward ? forward_mark_ : backward_mark_;
+        mark[c] = epoch_;
+        found.assign(1, c);
+        stack_.assign(1, c);
+        while (!stack_.empty()) {
+            lock_id const x = stack_.back();
+            stack_.pop_back();
+            for (std::size_t m = 0; m < members_[x].size(); ++m) {
+                std::vector<lock_id> const& next =
+                    forward ? out_[members_[x][m]] : in_[members_[x][m]];
+                for (std::size_t i = 0; i < next.size(); ++i) {
+                    lock_id const y = find(next[i]);
+                    if (mark[y] == epoch_ || order_[y] < lower ||
+                        order_[y] > upper)
+                        continue;
+                    mark[y] = epoch_;
+                    found.push_back(y);
+                    // Nothing past the far end can lead back in bounds.
+                    if (order_[y] != (forward ? upper : lower))
+                        stack_.push_back(y);
+                }
+            }
+        }
+    }
+
+    // Restores the topological order after adding an edge from component
+    // cu to component cv, merging the components on a new cycle.
+    void insert(lock_id cu, lock_id cv) {
+        if (cu == cv || order_[cu] < order_[cv])
+            return;
+        std::uint32_t const lower = order_[cv], upper = order_[cu];
+        ++epoch_;
+        search(cv, true, lower, upper, forward_);
+        search(cu, false, lower, upper, backward_);
+
+        // The components are given back the positions they held, with
+        // those reaching cu first and those reached from cv last. The
+        // latter take the highest positions even when merging leaves some
+        // unused, so that none moves below a component it came after.
+        slots_.clear();
+        for (std::size_t i = 0; i < forward_.size(); ++i)
+            slots_.push_back(order_[forward_[i]]);
+        for (std::size_t i = 0; i < backward_.size(); ++i)
+            if (forward_mark_[backward_[i]] != epoch_)
+                slots_.push_back(order_[backward_[i]]);
+        std::sort(slots_.begin(), slots_.end());
+
+        lock_id merged = cu;
+        if (forward_mark_[cu] == epoch_) {
+            // Everything both reached from cv and reaching cu is now on a
+            // cycle with the new edge.
+            for (std::size_t i = 0; i < backward_.size(); ++i)
+                if (forward_mark_[backward_[i]] == epoch_ &&
+                    members_[backward_[i]].size() > members_[merged].size())
+                    merged = backward_[i];
+            for (std::size_t i = 0; i < backward_.size(); ++i) {
+                lock_id const c = backward_[i];
+                if (forward_mark_[c] != epoch_ || c == merged)
+                    continue;
+                parent_[c] = merged;
+                members_[merged].insert(members_[merged].end(),
+                                        members_[c].begin(),
+                                        members_[c].end());
+                std::vector<lock_id>().swap(members_[c]);
+            }
+        }
+
+        std::vector<lock_id>::iterator const backward_end =
+            std::remove_if(backward_.begin(), backward_.end(),
+                [this](lock_id c) { return forward_mark_[c] == epoch_; });
+        std::vector<lock_id>::iterator const forward_end =
+            std::remove_if(forward_.begin(), forward_.end(),
+                [this](lock_id c) { return backward_mark_[c] == epoch_; });
+        std::sort(backward_.begin(), backward_end, by_order(order_));
+        std::sort(forward_.begin(), forward_end, by_order(order_));
+
+        std::size_t slot = 0;
+        for (std::vector<lock_id>::iterator it = backward_.begin();
+                                            it != backward_end; ++it)
+            order_[*it] = slots_[slot++];
+        if (forward_mark_[cu] == epoch_)
+            order_[merged] = slots_[slot];
+        slot = slots_.size() - (forward_end - forward_.begin());
+        for (std::vector<lock_id>::iterator it = forward_.begin();
+                                            it != forward_end; ++it)
+            order_[*it] = slots_[slot++];
+    }
+
+    struct by_order {
+        std::vector<std::uint32_t> const& order;
+        explicit by_order(std::vector<std::uint32_t> const& o) : order(o) { }
+        bool operator()(lock_id a, lock_id b) const {
+            return order[a] < order[b];
+        }
+    };
+
+    // Reports the valid cycles that use edge e, unless the same sequence of
+    // locks was already reported with other edges.
+    template <typename Report>
+    void find_cycles(std::uint32_t e, Report& report) {
+        edge const& added = locks_.edges()[e];
+        path_.assign(1, added.from);
+        path_.push_back(added.to);
+        chosen_.assign(1, e);
+        extend(find(added.from), report);
+    }
+
+    template <typename Report>
+    void extend(lock_id component, Report& report) {
+        std::vector<lock_id> const& next = out_[path_.back()];
+        for (std::size_t i = 0; i < next.size(); ++i) {
+            lock_id const l = next[i];
+            if (l == path_[0]) {
+                label(1, report);
+                continue;
+            }
+            if (path_.size() >= max_length_ || find(l) != component ||
+                std::find(path_.begin(), path_.end(), l) != path_.end())
+                continue;
+            path_.push_back(l);
+            extend(component, report);
+            path_.pop_back();
+        }
+    }
+
+    // Picks an edge for every hop of path_ after the first one, which is
+    // the edge just added, backtracking until one labelling is valid.
+    template <typename Report>
+    bool label(std::size_t hop, Report& report) {
+        if (hop == path_.size()) {
+            // Rotated to start from the smallest lock, as in goodlock.
+            std::vector<lock_id> locks(path_.begin(), path_.end());
+            std::rotate(locks.begin(),
+                        std::min_element(locks.begin(), locks.end()),
+                        locks.end());
+            if (!reported_.insert(locks).second)
+                return true;
+            potential_deadlock d;
+            for (std::size_t i = 0; i < chosen_.size(); ++i)
+                d.cycle.push_back(locks_.edges()[chosen_[i]]);
+            report(static_cast<potential_deadlock const&>(d));
+            return true;
+        }
+        lock_id const to = path_[(hop + 1) % path_.size()];
+        std::vector<std::uint32_t> const& labels =
+                                        labels_[pair(path_[hop], to)];
+        for (std::size_t i = 0; i < labels.size(); ++i) {
+            edge const& candidate = locks_.edges()[labels[i]];
+            bool ok = true;
+            for (std::size_t j = 0; ok && j < chosen_.size(); ++j) {
+                edge const& other = locks_.edges()[chosen_[j]];
+                ok = other.thread != candidate.thread &&
+                     goodlock_detail::disjoint(locks_.gates(other.gates),
+                                               locks_.gates(candidate.gates));
+            }
+            if (!ok)
+                continue;
+            chosen_.push_back(labels[i]);
+            bool const found = label(hop + 1, report);
+            chosen_.pop_back();
+            if (found)
+                return true;
+        }
+        return false;
+    }
+
+    lock_graph locks_;
+    std::size_t max_length_;
+    // Edges of locks_ between each pair of locks.
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t> > labels_;
+
+    // Per lock: its successors and predecessors, once per pair, and its
+    // parent in the union-find of components. Per component representative:
+    // its position in the topological order and its locks.
+    std::vector<std::vector<lock_id> > out_, in_;
+    std::vector<lock_id> parent_;
+    std::vector<std::uint32_t> order_;
+    std::vector<std::vector<lock_id> > members_;
+
+    std::uint32_t epoch_;
+    std::vector<std::uint32_t> forward_mark_, backward_mark_, slots_;
+    std::vector<lock_id> stack_, forward_, backward_, path_;
+    std::vector<std::uint32_t> chosen_;
+
+    struct hash_locks {
+        std::size_t operator()(std::vector<lock_id> const& locks) const {
+            std::size_t h = locks.size();
+            for (std::size_t i = 0; i < locks.size(); ++i)
+                h = h * 1000003u ^ locks[i];
+            return h;
+        }
+    };
+    std::unordered_set<std::vector<lock_id>, hash_locks> reported_;
+};
+
+// Feeds the events handed over by the recorder to an incremental_lock_graph
+// and calls `on_deadlock(potential_deadlock const&)` as soon as the events
+// make one possible. Only the per-thread order of the events matters to the
+// lock graph, so events can be consumed as they come:
+//
+//  online_deadlock_detector detector(report);
+//  recorder::flusher::instance().start("", std::ref(detector),
+//                                      std::chrono::milliseconds(2));
+//
+// Everything happens on the background thread of the recorder, including
+// the calls to on_deadlock. With a latency, a deadlock is reported even
+// when the threads involved are blocked in it, since mutex_wrapper records
+// an acquisition before waiting for the lock.
+class online_deadlock_detector {
+public:
+    typedef std::function<void (potential_deadlock const&)> callback;
+
+    explicit online_deadlock_detector(callback const& on_deadlock,
+                                      std::size_t max_length = 4)
+        : graph_(max_length), on_deadlock_(on_deadlock), deadlocks_(0)
+    { }
+
+    void operator()(recorded_event const* first, recorded_event const* last) {
+        consume(first, last);
+    }
+
+    void consume(recorded_event const* first, recorded_event const* last) {
+        for (; first != last; ++first) {
+            recorded_event const& e = *first;
+            if (e.kind == recorded_event::lock_acquire)
+                graph_.acquire(e.thread, e.object,
+                    [this](potential_deadlock const& d) {
+                        ++deadlocks_;
+                        on_deadlock_(d);
+                    });
+            else if (e.kind == recorded_event::lock_release)
+                graph_.release(e.thread, e.object);
+        }
+    }
+
+    std::size_t deadlocks() const { return deadlocks_; }
+    incremental_lock_graph const& graph() const { return graph_; }
+
+private:
+    incremental_lock_graph graph_;
+    callback on_deadlock_;
+    std::size_t deadlocks_;
+};
+
+// Defining D2_NO_DYNO leaves out what needs dyno, so that the rest can be
+// built and exercised on its own (see d2_benchmark.cpp).
+#ifndef D2_NO_DYNO
 struct thread_sync_domain
     : dyno::domain<dyno::root_domain, goodlock_analysis>
 { };
+#endif
 } // end namespace d2
 
 
 
 
 // Wrapper over a std::thread (or any other thread with the same interface and semantics)
+// recording its start, join and detach with d2::recorder.
 template <typename Thread>
 struct std_thread_wrapper : Thread {
     template <typename F, typename ...Args>
     explicit std_thread_wrapper(F&& f, Args&& ...args)
-        : Thread(std::forward<F>(f), std::forward<Args>(args)...)
+        : std_thread_wrapper(forked{d2::recorder::fork()},
+                             std::forward<F>(f), std::forward<Args>(args)...)
+    { }
+
+    void join() {
+        Thread::join();
+        d2::recorder::record(d2::recorded_event::thread_join, child_);
+    }
+
+    void detach() {
+        Thread::detach();
+        d2::recorder::record(d2::recorded_event::thread_detach, child_);
+    }
+
+private:
+    struct forked { std::uint64_t id; };
+
+    template <typename F>
+    struct body {
+        std::uint64_t id;
+        F f;
+
+        template <typename ...Args>
+        void operator()(Args&& ...args) {
+            d2::recorder::adopt(id);
+            f(std::forward<Args>(args)...);
+        }
+    };
+
+    template <typename F, typename ...Args>
+    std_thread_wrapper(forked child, F&& f, Args&& ...args)
+        : Thread(body<typename std::decay<F>::type>{child.id, std::forward<F>(f)},
+                 std::forward<Args>(args)...),
+          child_(child.id)
     { }
+
+    std::uint64_t child_;
 };
 
 typedef std_thread_wrapper<std::thread> WrappedThread;
 
+// Wrapper over a std::mutex (or any other lockable) recording its acquisitions
+// and releases with d2::recorder.
+//
+// An acquisition is recorded before waiting for the lock, so that a thread
+// blocked on it has already recorded the lock order it is blocked in. A
+// failed try_lock is recorded as an acquisition immediately released.
+template <typename Mutex>
+struct mutex_wrapper : Mutex {
+    void lock() {
+        d2::recorder::record(d2::recorded_event::lock_acquire, id());
+        Mutex::lock();
+    }
+
+    bool try_lock() {
+        d2::recorder::record(d2::recorded_event::lock_acquire, id());
+        if (Mutex::try_lock())
+            return true;
+        d2::recorder::record(d2::recorded_event::lock_release, id());
+        return false;
+    }
+
+    void unlock() {
+        d2::recorder::record(d2::recorded_event::lock_release, id());
+        Mutex::unlock();
+    }
+
+private:
+    std::uint64_t id() const { return reinterpret_cast<std::uintptr_t>(this); }
+};
+
+typedef mutex_wrapper<std::mutex> WrappedMutex;
+
 
 template <typename Event>
 struct dyno_event : boost::proto::extends<Event, dyno_event<Event> > { };
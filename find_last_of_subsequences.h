@@ -0,0 +1,211 @@
+/**
+ * This file defines the @em find_last_of_subsequences algorithm.
+ *
+ * @em find_last_of_subsequences(first1, last1, firsts2, lasts2, count, which)
+ * finds the last position in [first1, last1) where any of the @p count
+ * ranges [firsts2[i], lasts2[i]) occurs, in a single backward pass over the
+ * haystack. The index of the pattern found is stored in @p *which; if several
+ * patterns start at that position, the smallest index is stored.
+ *
+ * @note If no pattern occurs, @p last1 is returned and @p *which is set to
+ *       @p count. An empty pattern occurs at @p last1. If the automaton can't
+ *       be allocated, @p last1 is returned and @p *which is set to
+ *       <tt>(size_t)-1</tt>.
+ */
+
+#ifndef NSTL_ALGORITHM_FIND_LAST_OF_SUBSEQUENCES_H
+#define NSTL_ALGORITHM_FIND_LAST_OF_SUBSEQUENCES_H
+
+#include <nstl/internal.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+
+#define NSTL_FIND_LAST_OF_SUBSEQUENCES(                                        \
+                                BidirectionalTraversalReadableIterator1,       \
+                                BidirectionalTraversalReadableIterator2, T)    \
+    NSTL_I_FIND_LAST_OF_SUBSEQUENCES(                                          \
+        nstl_find_last_of_subsequences(                                        \
+                                BidirectionalTraversalReadableIterator1,       \
+                                BidirectionalTraversalReadableIterator2),      \
+        BidirectionalTraversalReadableIterator1,                               \
+        BidirectionalTraversalReadableIterator2,                               \
+        T                                                                      \
+    )                                                                          \
+/**/
+
+
+/*
+ * Aho-Corasick automaton over the reversed patterns, fed with the haystack
+ * from last1 backward. Reaching a state that completes a reversed pattern
+ * means that pattern starts at the current position, and since positions
+ * are visited in decreasing order the first such position is the answer.
+ *
+ * Elements are only compared for equality, so each node keeps its children
+ * in a list and remembers its label as an iterator into the pattern it was
+ * created from. best is the smallest pattern index completed at the node
+ * or at any node on its failure chain.
+ */
+#define NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE ((size_t)-1)
+
+#define NSTL_I_FIND_LAST_OF_SUBSEQUENCES(algo, Iter1, Iter2, T)                \
+NSTL_TYPE(algo,                                                                \
+                                                                               \
+(defun find_last_of_subsequences                                               \
+struct nstl_helper(algo, node) {                                               \
+    Iter2 label;                                                               \
+    size_t child;                                                              \
+    size_t sibling;                                                            \
+    size_t fail;                                                               \
+    size_t best;                                                               \
+};                                                                             \
+                                                                               \
+/* Child of node labelled like value, or NONE. */                              \
+static NSTL_INLINE size_t nstl_helper(algo, child)(                            \
+                    struct nstl_helper(algo, node) const *nodes,               \
+                    size_t node, T value) {                                    \
+    size_t c;                                                                  \
+    for (c = nodes[node].child; c != NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE;    \
+                                c = nodes[c].sibling)                          \
+        if (nstl_eq(T, T)(value, nstl_deref(Iter2)(nodes[c].label)))           \
+            return c;                                                          \
+    return NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE;                              \
+}                                                                              \
+                                                                               \
+/* Follows failure links until a transition on value exists. */                \
+static NSTL_INLINE size_t nstl_helper(algo, step)(                             \
+                    struct nstl_helper(algo, node) const *nodes,               \
+                    size_t state, T value) {                                   \
+    size_t next;                                                               \
+    while ((next = nstl_helper(algo, child)(nodes, state, value)) ==           \
+                NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE && state != 0)           \
+        state = nodes[state].fail;                                             \
+    return next == NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE ? 0 : next;           \
+}                                                                              \
+                                                                               \
+static nstl_bool nstl_helper(algo, build)(                                     \
+                    struct nstl_helper(algo, node) *nodes, size_t *size_,      \
+                    Iter2 const *firsts2, Iter2 const *lasts2, size_t count) { \
+    size_t size = 1, k, head, tail;                                            \
+    size_t *queue;                                                             \
+    nodes[0].child = nodes[0].sibling = NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE; \
+    nodes[0].fail = 0;                                                         \
+    nodes[0].best = NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE;                     \
+                                                                               \
+    for (k = 0; k < count; ++k) {                                              \
+        size_t node = 0;                                                       \
+        Iter2 it;                                                              \
+        nstl_copy_ctor(Iter2)(&it, lasts2[k]);                                 \
+        while (!nstl_eq(Iter2, Iter2)(it, firsts2[k])) {                       \
+            size_t next;                                                       \
+            nstl_dec(Iter2)(&it);                                              \
+            next = nstl_helper(algo, child)(nodes, node,                       \
+                                            nstl_deref(Iter2)(it));            \
+            if (next == NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE) {               \
+                next = size++;                                                 \
+                nstl_copy_ctor(Iter2)(&nodes[next].label, it);                 \
+                nodes[next].child = NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE;     \
+                nodes[next].sibling = nodes[node].child;                       \
+                nodes[next].best = NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE;      \
+                nodes[node].child = next;                                      \
+            }                                                                  \
+            node = next;                                                       \
+        }                                                                      \
+        nstl_dtor(Iter2)(&it);                                                 \
+        if (node != 0 && nodes[node].best > k)                                 \
+            nodes[node].best = k;                                              \
+    }                                                                          \
+                                                                               \
+    /* Breadth-first, so failure targets are complete before their users. */   \
+    *size_ = size;                                                             \
+    if ((queue = malloc(size * sizeof *queue)) == NULL)                        \
+        return nstl_false;                                                     \
+    head = tail = 0;                                                           \
+    queue[tail++] = 0;                                                         \
+    while (head != tail) {                                                     \
+        size_t const u = queue[head++];                                        \
+        size_t v;                                                              \
+        for (v = nodes[u].child; v != NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE;   \
+                                 v = nodes[v].sibling) {                       \
+            size_t f;                                                          \
+            nodes[v].fail = u == 0 ? 0 : nstl_helper(algo, step)(              \
+                nodes, nodes[u].fail, nstl_deref(Iter2)(nodes[v].label));      \
+            f = nodes[nodes[v].fail].best;                                     \
+            if (f < nodes[v].best)                                             \
+                nodes[v].best = f;                                             \
+            queue[tail++] = v;                                                 \
+        }                                                                      \
+    }                                                                          \
+    free(queue);                                                               \
+    return nstl_true;                                                          \
+}                                                                              \
+                                                                               \
+static Iter1 algo(Iter1 first1, Iter1 last1,                                   \
+                  Iter2 const *firsts2, Iter2 const *lasts2, size_t count,     \
+                  size_t *which) {                                             \
+    struct nstl_helper(algo, node) *nodes;                                     \
+    size_t capacity = 1, size, state, k;                                       \
+    nstl_bool built;                                                           \
+    Iter1 it;                                                                  \
+    nstl_copy_ctor(Iter1)(&it, last1);                                         \
+    *which = count;                                                            \
+                                                                               \
+    for (k = 0; k < count; ++k) {                                              \
+        Iter2 i2;                                                              \
+        if (nstl_eq(Iter2, Iter2)(firsts2[k], lasts2[k])) {                    \
+            *which = k;                                                        \
+            return it;                                                         \
+        }                                                                      \
+        nstl_copy_ctor(Iter2)(&i2, firsts2[k]);                                \
+        for (; !nstl_eq(Iter2, Iter2)(i2, lasts2[k]); nstl_inc(Iter2)(&i2))    \
+            ++capacity;                                                        \
+        nstl_dtor(Iter2)(&i2);                                                 \
+    }                                                                          \
+    if ((nodes = malloc(capacity * sizeof *nodes)) == NULL) {                  \
+        *which = NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE;                        \
+        return it;                                                             \
+    }                                                                          \
+    built = nstl_helper(algo, build)(nodes, &size, firsts2, lasts2, count);    \
+                                                                               \
+    for (state = 0; built && !nstl_eq(Iter1, Iter1)(it, first1); ) {           \
+        nstl_dec(Iter1)(&it);                                                  \
+        state = nstl_helper(algo, step)(nodes, state,                          \
+                                        nstl_deref(Iter1)(it));                \
+        if (nodes[state].best != NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE) {      \
+            *which = nodes[state].best;                                        \
+            break;                                                             \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    for (k = 1; k < size; ++k)                                                 \
+        nstl_dtor(Iter2)(&nodes[k].label);                                     \
+    free(nodes);                                                               \
+    if (!built)                                                                \
+        *which = NSTL_I_FIND_LAST_OF_SUBSEQUENCES_NONE;                        \
+    if (*which == count || !built)                                             \
+        nstl_asg(Iter1, Iter1)(&it, last1);                                    \
+    return it;                                                                 \
+}                                                                              \
+)                                                                              \
+                                                                               \
+)                                                                              \
+/**/
+
+
+/* [[[cog
+
+import nstl
+nstl.generate(cog,
+    'find_last_of_subsequences(BidirectionalTraversalReadableIterator1, ' +
+                               'BidirectionalTraversalReadableIterator2)',
+
+    token=True, mangle=True,
+)
+
+]]] */
+#include <joy/cat.h>
+#define NSTL_TOKEN_find_last_of_subsequences (f i n d _ l a s t _ o f _ s u b s e q u e n c e s)
+#define nstl_find_last_of_subsequences(BidirectionalTraversalReadableIterator1,  BidirectionalTraversalReadableIterator2) JOY_CAT5(nstl_mangled_find_last_of_subsequences, _, BidirectionalTraversalReadableIterator1, _,  BidirectionalTraversalReadableIterator2)
+/* [[[end]]] */
+
+#endif /* !NSTL_ALGORITHM_FIND_LAST_OF_SUBSEQUENCES_H */
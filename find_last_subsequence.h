@@ -1,15 +1,21 @@
 /**
- * This file defines the @em find_last_subsequence and
- * @em find_last_subsequence_comp algorithms.
+ * This file defines the @em find_last_subsequence,
+ * @em find_last_subsequence_comp and @em find_last_subsequence_parallel
+ * algorithms.
  *
  * @note These algorithms are equivalent to the @em find_end algorithms of the
- *       C++ standard library.
+ *       C++ standard library. @em find_last_subsequence_parallel takes the
+ *       number of threads to use as an additional argument; 0 means one per
+ *       online processor.
  */
 
 #ifndef NSTL_ALGORITHM_FIND_LAST_SUBSEQUENCE_H
 #define NSTL_ALGORITHM_FIND_LAST_SUBSEQUENCE_H
 
 #include <nstl/internal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 #define NSTL_FIND_LAST_SUBSEQUENCE(ForwardTraversalReadableIterator1,          \
@@ -29,11 +35,12 @@ NSTL_TYPE(algo,                                                                \
 (defun find_last_subsequence                                                   \
 typedef nstl_bool (*nstl_helper(algo, impl_comp))(T, T);                       \
 NSTL_GETF(                                                                     \
-    NSTL_I_FIND_LAST_SUBSEQUENCE_COMP(                                         \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_EQ(                                           \
         nstl_helper(algo, impl),                                               \
         Iter1,                                                                 \
         Iter2,                                                                 \
-        nstl_helper(algo, impl_comp)                                           \
+        nstl_helper(algo, impl_comp),                                          \
+        T                                                                      \
     ),                                                                         \
     find_last_subsequence_comp                                                 \
 )                                                                              \
@@ -63,6 +70,99 @@ static NSTL_INLINE Iter1 algo(Iter1 first1, Iter1 last1,                       \
 /**/
 
 
+#define NSTL_FIND_LAST_SUBSEQUENCE_PARALLEL(                                   \
+                                RandomAccessTraversalReadableIterator1,        \
+                                RandomAccessTraversalReadableIterator2, T)     \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_PARALLEL(                                     \
+        nstl_find_last_subsequence_parallel(                                   \
+                                RandomAccessTraversalReadableIterator1,        \
+                                RandomAccessTraversalReadableIterator2),       \
+        RandomAccessTraversalReadableIterator1,                                \
+        RandomAccessTraversalReadableIterator2,                                \
+        T                                                                      \
+    )                                                                          \
+/**/
+
+
+/*
+ * Traversal category of an iterator: FORWARD, BIDIRECTIONAL, RANDOM_ACCESS
+ * or CONTIGUOUS. An iterator is FORWARD unless it is registered before the
+ * algorithm is instantiated, e.g. for a plain pointer typedef'd char_ptr:
+ *
+ *     #define NSTL_TRAVERSAL_OF_char_ptr NSTL_TRAVERSAL(CONTIGUOUS)
+ *
+ * CONTIGUOUS iterators must be pointers.
+ */
+#ifndef NSTL_ITERATOR_TRAVERSAL
+#   define NSTL_TRAVERSAL(category) ~, category
+#   define NSTL_ITERATOR_TRAVERSAL(Iter)                                       \
+        NSTL_I_ITERATOR_TRAVERSAL(JOY_CAT2(NSTL_TRAVERSAL_OF_, Iter),          \
+                                  FORWARD, ~)                                  \
+    /**/
+#   define NSTL_I_ITERATOR_TRAVERSAL(...)                                      \
+        NSTL_I_ITERATOR_TRAVERSAL_II(__VA_ARGS__)                              \
+    /**/
+#   define NSTL_I_ITERATOR_TRAVERSAL_II(probe, category, ...) category
+#endif
+
+/*
+ * The implementation is selected by the weakest traversal category of the
+ * two iterators.
+ */
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_CATEGORY(Iter1, Iter2)                    \
+    JOY_CAT4(NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_,                                \
+             NSTL_ITERATOR_TRAVERSAL(Iter1), _,                                \
+             NSTL_ITERATOR_TRAVERSAL(Iter2))                                   \
+/**/
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_FORWARD_FORWARD             FORWARD
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_FORWARD_BIDIRECTIONAL       FORWARD
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_FORWARD_RANDOM_ACCESS       FORWARD
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_FORWARD_CONTIGUOUS          FORWARD
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_BIDIRECTIONAL_FORWARD       FORWARD
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_BIDIRECTIONAL_BIDIRECTIONAL BIDIRECTIONAL
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_BIDIRECTIONAL_RANDOM_ACCESS BIDIRECTIONAL
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_BIDIRECTIONAL_CONTIGUOUS    BIDIRECTIONAL
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_RANDOM_ACCESS_FORWARD       FORWARD
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_RANDOM_ACCESS_BIDIRECTIONAL BIDIRECTIONAL
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_RANDOM_ACCESS_RANDOM_ACCESS RANDOM_ACCESS
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_RANDOM_ACCESS_CONTIGUOUS    RANDOM_ACCESS
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_CONTIGUOUS_FORWARD          FORWARD
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_CONTIGUOUS_BIDIRECTIONAL    BIDIRECTIONAL
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_CONTIGUOUS_RANDOM_ACCESS    RANDOM_ACCESS
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_CONTIGUOUS_CONTIGUOUS       CONTIGUOUS
+
+/* Any comparison: plain reverse scan when random access is available. */
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_COMP(algo, Iter1, Iter2, Comp)            \
+    JOY_CAT2(NSTL_I_FIND_LAST_SUBSEQUENCE_COMP_,                               \
+             NSTL_I_FIND_LAST_SUBSEQUENCE_CATEGORY(Iter1, Iter2))              \
+        (algo, Iter1, Iter2, Comp)                                             \
+/**/
+
+/* Equality: the Boyer-Moore search can rely on it being an equivalence. */
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_EQ(algo, Iter1, Iter2, Comp, T)           \
+    JOY_CAT2(NSTL_I_FIND_LAST_SUBSEQUENCE_EQ_,                                 \
+             NSTL_I_FIND_LAST_SUBSEQUENCE_CATEGORY(Iter1, Iter2))              \
+        (algo, Iter1, Iter2, Comp, T)                                          \
+/**/
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_EQ_FORWARD(algo, Iter1, Iter2, Comp, T)   \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_COMP(algo, Iter1, Iter2, Comp)                \
+/**/
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_EQ_BIDIRECTIONAL(algo, Iter1, Iter2,      \
+                                                      Comp, T)                 \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_COMP(algo, Iter1, Iter2, Comp)                \
+/**/
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_EQ_RANDOM_ACCESS(algo, Iter1, Iter2,      \
+                                                      Comp, T)                 \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_BOYER_MOORE(algo, Iter1, Iter2, Comp)         \
+/**/
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_EQ_CONTIGUOUS                             \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_CONTIGUOUS                                    \
+/**/
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_COMP_CONTIGUOUS                           \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_COMP_RANDOM_ACCESS                            \
+/**/
+
+
 #define NSTL_I_FIND_LAST_SUBSEQUENCE_COMP_FORWARD(algo, Iter1, Iter2, Comp)    \
 NSTL_TYPE(algo,                                                                \
                                                                                \
@@ -81,7 +181,7 @@ static Iter1 algo(Iter1 first1_, Iter1 last1_,                                 \
                   Iter2 first2, Iter2 last2, Comp comp) {                      \
     Iter1 first1;                                                              \
     Iter1 result;                                                              \
-    if (nstl_eq(Iter1, Iter2)(first2, last2)) {                                \
+    if (nstl_eq(Iter2, Iter2)(first2, last2)) {                                \
         Iter1 last1;                                                           \
         nstl_copy_ctor(Iter1)(&last1, last1_);                                 \
         return last1;                                                          \
@@ -89,9 +189,9 @@ static Iter1 algo(Iter1 first1_, Iter1 last1_,                                 \
     nstl_copy_ctor(Iter1)(&result, last1_);                                    \
     nstl_copy_ctor(Iter1)(&first1, first1_);                                   \
     while (nstl_true) {                                                        \
-        Iter1 new_result = nstl_helper(algo, search_comp)(first1, last1,       \
+        Iter1 new_result = nstl_helper(algo, search_comp)(first1, last1_,      \
                                                          first2, last2, comp); \
-        if (nstl_eq(Iter1, Iter1)(new_result, last1)) {                        \
+        if (nstl_eq(Iter1, Iter1)(new_result, last1_)) {                       \
             nstl_dtor(Iter1)(&new_result);                                     \
             nstl_dtor(Iter1)(&first1);                                         \
             return result;                                                     \
@@ -107,6 +207,294 @@ static Iter1 algo(Iter1 first1_, Iter1 last1_,                                 \
 /**/
 
 
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_COMP_RANDOM_ACCESS(algo, Iter1, Iter2,    \
+                                                                        Comp)  \
+NSTL_TYPE(algo,                                                                \
+                                                                               \
+(defun find_last_subsequence_comp                                              \
+static NSTL_INLINE nstl_bool nstl_helper(algo, match_at)(                      \
+                    Iter1 first1, ptrdiff_t pos,                               \
+                    Iter2 first2, ptrdiff_t m, Comp comp) {                    \
+    ptrdiff_t i;                                                               \
+    for (i = 0; i < m; ++i)                                                    \
+        if (!comp(nstl_subscript(Iter1, ptrdiff_t)(first1, pos + i),           \
+                  nstl_subscript(Iter2, ptrdiff_t)(first2, i)))                \
+            return nstl_false;                                                 \
+    return nstl_true;                                                          \
+}                                                                              \
+                                                                               \
+static Iter1 algo(Iter1 first1, Iter1 last1,                                   \
+                  Iter2 first2, Iter2 last2, Comp comp) {                      \
+    ptrdiff_t const n = nstl_sub(Iter1, Iter1)(last1, first1);                 \
+    ptrdiff_t const m = nstl_sub(Iter2, Iter2)(last2, first2);                 \
+    ptrdiff_t pos;                                                             \
+    if (m == 0 || m > n)                                                       \
+        return nstl_add(Iter1, ptrdiff_t)(first1, n);                          \
+    for (pos = n - m; pos >= 0; --pos)                                         \
+        if (nstl_helper(algo, match_at)(first1, pos, first2, m, comp))         \
+            return nstl_add(Iter1, ptrdiff_t)(first1, pos);                    \
+    return nstl_add(Iter1, ptrdiff_t)(first1, n);                              \
+}                                                                              \
+)                                                                              \
+                                                                               \
+)                                                                              \
+/**/
+
+
+/*
+ * Boyer-Moore search running from the end of the haystack. The pattern is
+ * compared from its first element onward, and a mismatch after matching a
+ * prefix of length k shifts the window left by shift[k]. This is the good
+ * suffix rule applied to the reversed pattern, so it only needs Comp to be
+ * an equivalence relation; no ordering or hashing of the elements is
+ * required. Tables for needles of up to NSTL_I_FIND_LAST_SUBSEQUENCE_BM_STACK
+ * elements live on the stack; longer needles use malloc and fall back to
+ * the plain reverse scan if the allocation fails.
+ */
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_BM_STACK 64
+
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_BOYER_MOORE(algo, Iter1, Iter2, Comp)     \
+NSTL_TYPE(algo,                                                                \
+                                                                               \
+(defun find_last_subsequence_comp                                              \
+NSTL_GETF(                                                                     \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_COMP_RANDOM_ACCESS(                           \
+        nstl_helper(algo, scan),                                               \
+        Iter1,                                                                 \
+        Iter2,                                                                 \
+        Comp                                                                   \
+    ),                                                                         \
+    find_last_subsequence_comp                                                 \
+)                                                                              \
+                                                                               \
+/* Element k of the reversed needle. */                                        \
+static NSTL_INLINE nstl_bool nstl_helper(algo, rev_eq)(                        \
+                    Iter2 first2, ptrdiff_t m, ptrdiff_t i, ptrdiff_t j,       \
+                    Comp comp) {                                               \
+    return comp(nstl_subscript(Iter2, ptrdiff_t)(first2, m - 1 - i),           \
+                nstl_subscript(Iter2, ptrdiff_t)(first2, m - 1 - j));          \
+}                                                                              \
+                                                                               \
+static void nstl_helper(algo, shifts)(Iter2 first2, ptrdiff_t m,               \
+                                      ptrdiff_t *shift, ptrdiff_t *suff,       \
+                                      Comp comp) {                             \
+    ptrdiff_t f = 0, g, i, j;                                                  \
+    suff[m - 1] = m;                                                           \
+    g = m - 1;                                                                 \
+    for (i = m - 2; i >= 0; --i) {                                             \
+        if (i > g && suff[i + m - 1 - f] < i - g)                              \
+            suff[i] = suff[i + m - 1 - f];                                     \
+        else {                                                                 \
+            if (i < g)                                                         \
+                g = i;                                                         \
+            f = i;                                                             \
+            while (g >= 0 &&                                                   \
+                   nstl_helper(algo, rev_eq)(first2, m, g, g + m - 1 - f,      \
+                                             comp))                            \
+                --g;                                                           \
+            suff[i] = f - g;                                                   \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    for (i = 0; i < m; ++i)                                                    \
+        shift[i] = m;                                                          \
+    for (i = m - 1, j = 0; i >= 0; --i)                                        \
+        if (suff[i] == i + 1)                                                  \
+            for (; j < m - 1 - i; ++j)                                         \
+                if (shift[j] == m)                                             \
+                    shift[j] = m - 1 - i;                                      \
+    for (i = 0; i <= m - 2; ++i)                                               \
+        shift[m - 1 - suff[i]] = m - 1 - i;                                    \
+}                                                                              \
+                                                                               \
+static Iter1 algo(Iter1 first1, Iter1 last1,                                   \
+                  Iter2 first2, Iter2 last2, Comp comp) {                      \
+    ptrdiff_t const n = nstl_sub(Iter1, Iter1)(last1, first1);                 \
+    ptrdiff_t const m = nstl_sub(Iter2, Iter2)(last2, first2);                 \
+    ptrdiff_t stack[2 * NSTL_I_FIND_LAST_SUBSEQUENCE_BM_STACK];                \
+    ptrdiff_t *shift, *suff;                                                   \
+    ptrdiff_t pos, k;                                                          \
+    if (m == 0 || m > n)                                                       \
+        return nstl_add(Iter1, ptrdiff_t)(first1, n);                          \
+                                                                               \
+    if (m <= NSTL_I_FIND_LAST_SUBSEQUENCE_BM_STACK)                            \
+        shift = stack;                                                         \
+    else if ((shift = malloc(2 * m * sizeof *shift)) == NULL)                  \
+        return nstl_helper(algo, scan)(first1, last1, first2, last2, comp);    \
+    suff = shift + m;                                                          \
+    nstl_helper(algo, shifts)(first2, m, shift, suff, comp);                   \
+                                                                               \
+    /* shift[m - 1 - k] is the shift after matching a prefix of length k. */   \
+    for (pos = n - m; pos >= 0; ) {                                            \
+        for (k = 0; k < m; ++k)                                                \
+            if (!comp(nstl_subscript(Iter1, ptrdiff_t)(first1, pos + k),       \
+                      nstl_subscript(Iter2, ptrdiff_t)(first2, k)))            \
+                break;                                                         \
+        if (k == m)                                                            \
+            break;                                                             \
+        pos -= shift[m - 1 - k];                                               \
+    }                                                                          \
+                                                                               \
+    if (shift != stack)                                                        \
+        free(shift);                                                           \
+    return nstl_add(Iter1, ptrdiff_t)(first1, pos < 0 ? n : pos);              \
+}                                                                              \
+)                                                                              \
+                                                                               \
+)                                                                              \
+/**/
+
+
+/*
+ * Reverse search over contiguous bytes, used when both ranges are pointers
+ * to one-byte elements. Candidate windows are those whose first and last
+ * bytes match the needle's; they are found 16 (SSE2) or 32 (AVX2) windows
+ * at a time, walking backward from the end of the haystack, and only then
+ * verified with memcmp. The vector width is chosen once, at runtime.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#   define NSTL_I_FIND_LAST_BYTES_X86
+#   include <immintrin.h>
+#endif
+
+static NSTL_INLINE unsigned char const *
+nstl_i_find_last_bytes_scalar(unsigned char const *hay, ptrdiff_t n,
+                              unsigned char const *needle, ptrdiff_t m,
+                              ptrdiff_t pos) {
+    for (; pos >= 0; --pos)
+        if (hay[pos + m - 1] == needle[m - 1] && hay[pos] == needle[0] &&
+            memcmp(hay + pos, needle, m) == 0)
+            return hay + pos;
+    (void)n;
+    return NULL;
+}
+
+#ifdef NSTL_I_FIND_LAST_BYTES_X86
+#define NSTL_I_FIND_LAST_BYTES_VECTOR(name, isa, vec, width, set1, load,       \
+                                      cmpeq, and_, movemask)                   \
+__attribute__((target(isa))) static NSTL_INLINE unsigned char const *          \
+name(unsigned char const *hay, ptrdiff_t n,                                    \
+     unsigned char const *needle, ptrdiff_t m, ptrdiff_t pos) {                \
+    vec const first = set1((char)needle[0]);                                   \
+    vec const last = set1((char)needle[m - 1]);                                \
+    ptrdiff_t block;                                                           \
+    for (block = pos - (width - 1); block >= 0; block -= width) {              \
+        unsigned mask = (unsigned)movemask(and_(                               \
+            cmpeq(first, load((vec const *)(hay + block))),                    \
+            cmpeq(last, load((vec const *)(hay + block + m - 1)))));           \
+        while (mask != 0) {                                                    \
+            int const bit = 31 - __builtin_clz(mask);                          \
+            if (m <= 2 ||                                                      \
+                memcmp(hay + block + bit + 1, needle + 1, m - 2) == 0)         \
+                return hay + block + bit;                                      \
+            mask &= ~(1u << bit);                                              \
+        }                                                                      \
+    }                                                                          \
+    return nstl_i_find_last_bytes_scalar(hay, n, needle, m,                    \
+                                         block + (width - 1));                 \
+}                                                                              \
+/**/
+NSTL_I_FIND_LAST_BYTES_VECTOR(nstl_i_find_last_bytes_sse2, "sse2", __m128i,
+                              16, _mm_set1_epi8, _mm_loadu_si128,
+                              _mm_cmpeq_epi8, _mm_and_si128,
+                              _mm_movemask_epi8)
+NSTL_I_FIND_LAST_BYTES_VECTOR(nstl_i_find_last_bytes_avx2, "avx2", __m256i,
+                              32, _mm256_set1_epi8, _mm256_loadu_si256,
+                              _mm256_cmpeq_epi8, _mm256_and_si256,
+                              _mm256_movemask_epi8)
+#endif
+
+typedef unsigned char const *(*nstl_i_find_last_bytes_fn)(
+    unsigned char const *, ptrdiff_t, unsigned char const *, ptrdiff_t,
+    ptrdiff_t);
+
+static NSTL_INLINE nstl_i_find_last_bytes_fn
+nstl_i_find_last_bytes_select(void) {
+#ifdef NSTL_I_FIND_LAST_BYTES_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return nstl_i_find_last_bytes_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return nstl_i_find_last_bytes_sse2;
+#endif
+    return nstl_i_find_last_bytes_scalar;
+}
+
+/*
+ * Returns the beginning of the last occurrence of the needle, or NULL.
+ * The selected implementation is cached atomically, since the parallel
+ * algorithm calls this from several threads at once.
+ */
+static NSTL_INLINE unsigned char const *
+nstl_i_find_last_bytes(unsigned char const *hay, ptrdiff_t n,
+                       unsigned char const *needle, ptrdiff_t m) {
+    static nstl_i_find_last_bytes_fn cached = NULL;
+    nstl_i_find_last_bytes_fn impl;
+    if (m == 0 || m > n)
+        return NULL;
+    impl = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    if (impl == NULL) {
+        impl = nstl_i_find_last_bytes_select();
+        __atomic_store_n(&cached, impl, __ATOMIC_RELAXED);
+    }
+    return impl(hay, n, needle, m, n - m);
+}
+
+
+/*
+ * Whether an expression is of a character type, whose equality is always
+ * that of its bytes. Other one-byte types may have their own nstl_eq.
+ */
+#define NSTL_I_IS_BYTE(expr)                                                   \
+    (__builtin_types_compatible_p(__typeof__(expr), char) ||                   \
+     __builtin_types_compatible_p(__typeof__(expr), signed char) ||            \
+     __builtin_types_compatible_p(__typeof__(expr), unsigned char))            \
+/**/
+
+/*
+ * Contiguous ranges are plain pointers. Characters compared with the
+ * default nstl_eq(T, T) go through the vectorized byte search; anything
+ * else uses the Boyer-Moore search.
+ */
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_CONTIGUOUS(algo, Iter1, Iter2, Comp, T)   \
+NSTL_TYPE(algo,                                                                \
+                                                                               \
+(defun find_last_subsequence_comp                                              \
+NSTL_GETF(                                                                     \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_BOYER_MOORE(                                  \
+        nstl_helper(algo, boyer_moore),                                        \
+        Iter1,                                                                 \
+        Iter2,                                                                 \
+        Comp                                                                   \
+    ),                                                                         \
+    find_last_subsequence_comp                                                 \
+)                                                                              \
+                                                                               \
+static NSTL_INLINE Iter1 algo(Iter1 first1, Iter1 last1,                       \
+                              Iter2 first2, Iter2 last2, Comp comp) {          \
+    if (NSTL_I_IS_BYTE(*first1) && NSTL_I_IS_BYTE(*first2) &&                \
+        comp == nstl_eq(T, T)) {                                               \
+        unsigned char const *match = nstl_i_find_last_bytes(                   \
+            (unsigned char const *)first1, last1 - first1,                     \
+            (unsigned char const *)first2, last2 - first2);                    \
+        if (match == NULL)                                                     \
+            return last1;                                                      \
+        return first1 + (match - (unsigned char const *)first1);               \
+    }                                                                          \
+    return nstl_helper(algo, boyer_moore)(first1, last1, first2, last2, comp); \
+}                                                                              \
+)                                                                              \
+                                                                               \
+)                                                                              \
+/**/
+
+
+/*
+ * Searching the reversed ranges from their beginning: the needle is matched
+ * backward from each candidate end position, starting at last1, so the
+ * first match found is the last one and nothing before it is visited.
+ */
 #define NSTL_I_FIND_LAST_SUBSEQUENCE_COMP_BIDIRECTIONAL(algo, Iter1, Iter2,    \
                                                                         Comp)  \
 NSTL_TYPE(algo,                                                                \
@@ -114,16 +502,185 @@ NSTL_TYPE(algo,                                                                \
 (defun find_last_subsequence_comp                                              \
 static Iter1 algo(Iter1 first1, Iter1 last1,                                   \
                   Iter2 first2, Iter2 last2, Comp comp) {                      \
-    nstl_reverse_iterator1 rfirst1(last1);                                     \
-    nstl_reverse_iterator1 rlast1(first1);                                     \
-    nstl_reverse_iterator1 rfirst2(last2);                                     \
-    nstl_reverse_iterator2 rlast2(first2);                                     \
-    nstl_reverse_iterator1 rresult = nstl_search(rfirst1, rlast1 rfirst2, rlast2, comp); \
-    if (rresult == rlast1)                                                     \
-        return last1;                                                          \
-    Iter1 result = rresult.base();                                             \
-    advance(result, -distance(first2, last2));                                 \
-    return result;                                                             \
+    Iter1 end;                                                                 \
+    Iter1 it1;                                                                 \
+    Iter2 it2;                                                                 \
+    nstl_bool mismatch;                                                        \
+    nstl_copy_ctor(Iter1)(&end, last1);                                        \
+    while (nstl_true) {                                                        \
+        nstl_copy_ctor(Iter1)(&it1, end);                                      \
+        nstl_copy_ctor(Iter2)(&it2, last2);                                    \
+        mismatch = nstl_false;                                                 \
+        while (!mismatch && !nstl_eq(Iter2, Iter2)(it2, first2)) {             \
+            if (nstl_eq(Iter1, Iter1)(it1, first1)) {                          \
+                /* Not enough elements left before end for any match. */       \
+                nstl_dtor(Iter1)(&it1);                                        \
+                nstl_dtor(Iter2)(&it2);                                        \
+                nstl_asg(Iter1, Iter1)(&end, last1);                           \
+                return end;                                                    \
+            }                                                                  \
+            nstl_dec(Iter1)(&it1);                                             \
+            nstl_dec(Iter2)(&it2);                                             \
+            mismatch = !comp(nstl_deref(Iter1)(it1), nstl_deref(Iter2)(it2));  \
+        }                                                                      \
+        nstl_dtor(Iter2)(&it2);                                                \
+        if (!mismatch) {                                                       \
+            nstl_dtor(Iter1)(&end);                                            \
+            return it1;                                                        \
+        }                                                                      \
+        nstl_dtor(Iter1)(&it1);                                                \
+        if (nstl_eq(Iter1, Iter1)(end, first1)) {                              \
+            nstl_asg(Iter1, Iter1)(&end, last1);                               \
+            return end;                                                        \
+        }                                                                      \
+        nstl_dec(Iter1)(&end);                                                 \
+    }                                                                          \
+}                                                                              \
+)                                                                              \
+                                                                               \
+)                                                                              \
+/**/
+
+
+/*
+ * Thread support for find_last_subsequence_parallel. Without POSIX threads,
+ * the work is done by the calling thread alone.
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#   include <pthread.h>
+#   include <unistd.h>
+#   define NSTL_I_FIND_LAST_SUBSEQUENCE_THREADS
+#endif
+
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MAX_THREADS 256
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_CHUNK ((ptrdiff_t)1 << 16)
+
+static NSTL_INLINE unsigned nstl_i_find_last_subsequence_threads(void) {
+#ifdef NSTL_I_FIND_LAST_SUBSEQUENCE_THREADS
+    long const online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0)
+        return (unsigned)online;
+#endif
+    return 1;
+}
+
+/* Runs worker(shared) on nthreads threads, the calling thread included. */
+static NSTL_INLINE void
+nstl_i_find_last_subsequence_spawn(void *(*worker)(void *), void *shared,
+                                   unsigned nthreads) {
+#ifdef NSTL_I_FIND_LAST_SUBSEQUENCE_THREADS
+    pthread_t threads[NSTL_I_FIND_LAST_SUBSEQUENCE_MAX_THREADS];
+    unsigned i, started = 0;
+    for (i = 1; i < nthreads; ++i)
+        if (pthread_create(&threads[started], NULL, worker, shared) == 0)
+            ++started;
+    worker(shared);
+    for (i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+#else
+    (void)nthreads;
+    worker(shared);
+#endif
+}
+
+/*
+ * The window starts are split into chunks, each extended by m - 1 elements
+ * so that no match straddling two chunks is lost. Chunks are handed out
+ * from the back, but a chunk handed out earlier may still be searched after
+ * a later one, so a chunk is skipped only when the recorded match is at or
+ * after its last window start. Each thread takes chunks in decreasing order,
+ * so it can stop at the first chunk it skips. Chunks are kept small
+ * compared to the range so that this happens early.
+ */
+#define NSTL_I_FIND_LAST_SUBSEQUENCE_PARALLEL(algo, Iter1, Iter2, T)           \
+NSTL_TYPE(algo,                                                                \
+                                                                               \
+(defun find_last_subsequence_parallel                                          \
+typedef nstl_bool (*nstl_helper(algo, impl_comp))(T, T);                       \
+NSTL_GETF(                                                                     \
+    NSTL_I_FIND_LAST_SUBSEQUENCE_EQ(                                           \
+        nstl_helper(algo, impl),                                               \
+        Iter1,                                                                 \
+        Iter2,                                                                 \
+        nstl_helper(algo, impl_comp),                                          \
+        T                                                                      \
+    ),                                                                         \
+    find_last_subsequence_comp                                                 \
+)                                                                              \
+                                                                               \
+struct nstl_helper(algo, shared) {                                             \
+    Iter1 first1;                                                              \
+    Iter2 first2;                                                              \
+    Iter2 last2;                                                               \
+    ptrdiff_t m;                                                               \
+    ptrdiff_t last_start;                                                      \
+    ptrdiff_t chunk;                                                           \
+    ptrdiff_t next;                                                            \
+    ptrdiff_t best;                                                            \
+};                                                                             \
+                                                                               \
+static void *nstl_helper(algo, worker)(void *shared_) {                        \
+    struct nstl_helper(algo, shared) *shared = shared_;                        \
+    ptrdiff_t c;                                                               \
+    while ((c = __atomic_fetch_sub(&shared->next, 1,                           \
+                                   __ATOMIC_RELAXED)) >= 0) {                  \
+        ptrdiff_t const begin = c * shared->chunk;                             \
+        ptrdiff_t end = begin + shared->chunk;                                 \
+        ptrdiff_t pos, best;                                                   \
+        Iter1 first, last, found;                                              \
+        if (end > shared->last_start + 1)                                      \
+            end = shared->last_start + 1;                                      \
+        if (__atomic_load_n(&shared->best, __ATOMIC_RELAXED) >= end - 1)       \
+            break;                                                             \
+        first = nstl_add(Iter1, ptrdiff_t)(shared->first1, begin);             \
+        last = nstl_add(Iter1, ptrdiff_t)(shared->first1,                      \
+                                          end + shared->m - 1);                \
+        found = nstl_helper(algo, impl)(first, last,                           \
+                                        shared->first2, shared->last2,         \
+                                        nstl_eq(T, T));                        \
+        if (nstl_eq(Iter1, Iter1)(found, last))                                \
+            continue;                                                          \
+        pos = nstl_sub(Iter1, Iter1)(found, shared->first1);                   \
+        best = __atomic_load_n(&shared->best, __ATOMIC_RELAXED);               \
+        while (pos > best &&                                                   \
+               !__atomic_compare_exchange_n(&shared->best, &best, pos,         \
+                                            nstl_false, __ATOMIC_RELAXED,      \
+                                            __ATOMIC_RELAXED))                 \
+            ;                                                                  \
+    }                                                                          \
+    return NULL;                                                               \
+}                                                                              \
+                                                                               \
+static Iter1 algo(Iter1 first1, Iter1 last1,                                   \
+                  Iter2 first2, Iter2 last2, unsigned nthreads) {              \
+    struct nstl_helper(algo, shared) shared;                                   \
+    ptrdiff_t const n = nstl_sub(Iter1, Iter1)(last1, first1);                 \
+    ptrdiff_t const m = nstl_sub(Iter2, Iter2)(last2, first2);                 \
+    if (m == 0 || m > n)                                                       \
+        return nstl_add(Iter1, ptrdiff_t)(first1, n);                          \
+    if (nthreads == 0)                                                         \
+        nthreads = nstl_i_find_last_subsequence_threads();                     \
+    if (nthreads > NSTL_I_FIND_LAST_SUBSEQUENCE_MAX_THREADS)                   \
+        nthreads = NSTL_I_FIND_LAST_SUBSEQUENCE_MAX_THREADS;                   \
+                                                                               \
+    shared.first1 = first1;                                                    \
+    shared.first2 = first2;                                                    \
+    shared.last2 = last2;                                                      \
+    shared.m = m;                                                              \
+    shared.last_start = n - m;                                                 \
+    shared.chunk = (n - m + 1) / ((ptrdiff_t)nthreads * 16);                   \
+    if (shared.chunk < NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_CHUNK)                 \
+        shared.chunk = NSTL_I_FIND_LAST_SUBSEQUENCE_MIN_CHUNK;                 \
+    shared.next = (n - m) / shared.chunk;                                      \
+    shared.best = -1;                                                          \
+    if (nthreads == 1 || shared.next == 0)                                     \
+        return nstl_helper(algo, impl)(first1, last1, first2, last2,           \
+                                       nstl_eq(T, T));                         \
+                                                                               \
+    nstl_i_find_last_subsequence_spawn(nstl_helper(algo, worker), &shared,     \
+                                       nthreads);                              \
+    return nstl_add(Iter1, ptrdiff_t)(first1,                                  \
+                                      shared.best < 0 ? n : shared.best);      \
 }                                                                              \
 )                                                                              \
                                                                                \
@@ -140,6 +697,8 @@ nstl.generate(cog,
     'find_last_subsequence_comp(ForwardTraversalReadableIterator1, ' +
                                 'ForwardTraversalReadableIterator2, ' +
                                 'Compare)',
+    'find_last_subsequence_parallel(RandomAccessTraversalReadableIterator1, ' +
+                                    'RandomAccessTraversalReadableIterator2)',
 
     token=True, mangle=True,
 )
@@ -150,6 +709,8 @@ nstl.generate(cog,
 #define nstl_find_last_subsequence(ForwardTraversalReadableIterator1,  ForwardTraversalReadableIterator2) JOY_CAT5(nstl_mangled_find_last_subsequence, _, ForwardTraversalReadableIterator1, _,  ForwardTraversalReadableIterator2)
 #define NSTL_TOKEN_find_last_subsequence_comp (f i n d _ l a s t _ s u b s e q u e n c e _ c o m p)
 #define nstl_find_last_subsequence_comp(ForwardTraversalReadableIterator1,  ForwardTraversalReadableIterator2,  Compare) JOY_CAT7(nstl_mangled_find_last_subsequence_comp, _, ForwardTraversalReadableIterator1, _,  ForwardTraversalReadableIterator2, _,  Compare)
+#define NSTL_TOKEN_find_last_subsequence_parallel (f i n d _ l a s t _ s u b s e q u e n c e _ p a r a l l e l)
+#define nstl_find_last_subsequence_parallel(RandomAccessTraversalReadableIterator1,  RandomAccessTraversalReadableIterator2) JOY_CAT5(nstl_mangled_find_last_subsequence_parallel, _, RandomAccessTraversalReadableIterator1, _,  RandomAccessTraversalReadableIterator2)
 /* [[[end]]] */
 
 #endif /* !NSTL_ALGORITHM_FIND_LAST_SUBSEQUENCE_H */
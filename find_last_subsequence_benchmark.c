@@ -0,0 +1,295 @@
+/**
+ * Benchmarks of the backends of find_last_subsequence, and of
+ * find_last_of_subsequences.
+ *
+ * Build and run, with nstl and joy in the include path :
+ *      cc -std=gnu99 -O2 find_last_subsequence_benchmark.c -lpthread \
+ *          -o find_last_subsequence_benchmark
+ *      ./find_last_subsequence_benchmark
+ *
+ * Each backend is instantiated on plain pointers registered with the
+ * traversal category that selects it. Before a result is printed, the
+ * backends that were timed are checked to find the same match; the program
+ * fails if any of them does not.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef char const *char_fwd;       /* repeated forward search */
+typedef char const *char_bidi;      /* backward search */
+typedef char const *char_random;    /* Boyer-Moore search */
+typedef char const *char_ptr;       /* vectorized byte search */
+#define NSTL_TRAVERSAL_OF_char_bidi NSTL_TRAVERSAL(BIDIRECTIONAL)
+#define NSTL_TRAVERSAL_OF_char_random NSTL_TRAVERSAL(RANDOM_ACCESS)
+#define NSTL_TRAVERSAL_OF_char_ptr NSTL_TRAVERSAL(CONTIGUOUS)
+
+#include "find_last_of_subsequences.h"
+#include "find_last_subsequence.h"
+
+NSTL_FIND_LAST_SUBSEQUENCE(char_fwd, char_fwd, char)
+NSTL_FIND_LAST_SUBSEQUENCE(char_bidi, char_bidi, char)
+NSTL_FIND_LAST_SUBSEQUENCE(char_random, char_random, char)
+NSTL_FIND_LAST_SUBSEQUENCE(char_ptr, char_ptr, char)
+NSTL_FIND_LAST_SUBSEQUENCE_PARALLEL(char_random, char_random, char)
+NSTL_FIND_LAST_SUBSEQUENCE_PARALLEL(char_ptr, char_ptr, char)
+NSTL_FIND_LAST_OF_SUBSEQUENCES(char_ptr, char_ptr, char)
+
+
+static int failures = 0;
+
+static void check(int ok, char const *what) {
+    if (!ok) {
+        ++failures;
+        printf("FAILED: %s\n", what);
+    }
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static unsigned long random_state = 1;
+
+static unsigned long next_random(void) {
+    random_state = random_state * 6364136223846793005ul +
+                   1442695040888963407ul;
+    return random_state >> 33;
+}
+
+/* A haystack of n random lowercase letters. */
+static char *random_letters(size_t n) {
+    char *hay = malloc(n);
+    size_t i;
+    if (hay == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; ++i)
+        hay[i] = 'a' + next_random() % 26;
+    return hay;
+}
+
+typedef char const *(*find_last)(char const *, char const *,
+                                 char const *, char const *);
+
+/* Average seconds per call of find over rounds calls; *found is its result. */
+static double time_find(find_last find, char const *hay, size_t n,
+                        char const *needle, size_t m, int rounds,
+                        char const **found) {
+    double const start = now();
+    int r;
+    for (r = 0; r < rounds; ++r)
+        *found = find(hay, hay + n, needle, needle + m);
+    return (now() - start) / rounds;
+}
+
+
+/*
+ * Makes the letters from hay + at a needle that occurs nowhere else in a
+ * haystack of lowercase letters, by making its first letter uppercase.
+ */
+static char const *plant_needle(char *hay, size_t at) {
+    hay[at] = 'A' + next_random() % 26;
+    return hay + at;
+}
+
+/*
+ * Needles of 4 to 64 letters in 64 MB of random letters: the forward
+ * search, which starts over after each match, against the Boyer-Moore
+ * search of random access iterators and the byte search of contiguous ones.
+ * The needle occurs once, either near the front, so that the reverse
+ * searches go through the whole haystack like the forward one, or near the
+ * end, where they stop right away.
+ */
+static void bench_needle_lengths(void) {
+    size_t const n = (size_t)1 << 26;
+    int const rounds = 3;
+    char *hay = random_letters(n);
+    int near_end;
+    size_t m;
+
+    for (near_end = 0; near_end < 2; ++near_end) {
+        for (m = 4; m <= 64; m *= 2) {
+            size_t const at = near_end ? n - 4096 : 4096;
+            char const *needle = plant_needle(hay, at);
+            char const *forward, *boyer_moore, *bytes;
+            double const forward_s = time_find(
+                nstl_find_last_subsequence(char_fwd, char_fwd),
+                hay, n, needle, m, rounds, &forward);
+            double const boyer_moore_s = time_find(
+                nstl_find_last_subsequence(char_random, char_random),
+                hay, n, needle, m, rounds, &boyer_moore);
+            double const bytes_s = time_find(
+                nstl_find_last_subsequence(char_ptr, char_ptr),
+                hay, n, needle, m, rounds, &bytes);
+
+            check(forward == needle && boyer_moore == needle &&
+                  bytes == needle, "needle lengths: planted needle found");
+            printf("%2u letters, match near the %s: forward %7.2f, "
+                   "Boyer-Moore %7.3f, byte search %7.3f ms\n",
+                   (unsigned)m, near_end ? "end  " : "front",
+                   forward_s * 1e3, boyer_moore_s * 1e3, bytes_s * 1e3);
+            hay[at] = 'a';
+        }
+    }
+    free(hay);
+}
+
+/*
+ * find_last_subsequence_parallel on 256 MB of random letters, with a needle
+ * of 16 letters near the front so that the whole haystack is searched, from
+ * one thread up to one per online processor.
+ */
+static void bench_parallel(void) {
+    size_t const n = (size_t)1 << 28, m = 16;
+    long const online = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned const cores = online > 0 ? (unsigned)online : 1;
+    char *hay = random_letters(n);
+    char const *needle = plant_needle(hay, 4096);
+    unsigned threads;
+
+    for (threads = 1; ; threads = threads * 2 < cores ? threads * 2 : cores) {
+        char const *boyer_moore, *bytes;
+        double boyer_moore_s, bytes_s;
+        double const start = now();
+        boyer_moore = nstl_find_last_subsequence_parallel(
+            char_random, char_random)(hay, hay + n, needle, needle + m,
+                                      threads);
+        boyer_moore_s = now() - start;
+        bytes = nstl_find_last_subsequence_parallel(char_ptr, char_ptr)(
+            hay, hay + n, needle, needle + m, threads);
+        bytes_s = now() - start - boyer_moore_s;
+
+        check(boyer_moore == needle && bytes == needle,
+              "parallel: planted needle found");
+        printf("%3u threads: Boyer-Moore %6.2f, byte search %6.2f GB/s\n",
+               threads, n / boyer_moore_s / 1e9, n / bytes_s / 1e9);
+        if (threads == cores)
+            break;
+    }
+    free(hay);
+}
+
+/*
+ * The search of bidirectional iterators against the forward search, with a
+ * needle of 16 letters at different distances from the end of 64 MB of
+ * random letters. Only the elements after the match are visited by the
+ * former, while the latter always goes through the whole haystack.
+ */
+static void bench_bidirectional(void) {
+    size_t const n = (size_t)1 << 26, m = 16;
+    int const rounds = 3;
+    char *hay = random_letters(n);
+    size_t from_end;
+
+    for (from_end = 1024; from_end <= n; from_end *= 16) {
+        size_t const at = n - from_end;
+        char const *needle = plant_needle(hay, at);
+        char const *forward, *bidirectional;
+        double const forward_s = time_find(
+            nstl_find_last_subsequence(char_fwd, char_fwd),
+            hay, n, needle, m, rounds, &forward);
+        double const bidirectional_s = time_find(
+            nstl_find_last_subsequence(char_bidi, char_bidi),
+            hay, n, needle, m, rounds, &bidirectional);
+
+        check(forward == needle && bidirectional == needle,
+              "bidirectional: planted needle found");
+        printf("match %9u letters from the end: forward %7.2f, "
+               "bidirectional %7.3f ms\n", (unsigned)from_end,
+               forward_s * 1e3, bidirectional_s * 1e3);
+        hay[at] = 'a';
+    }
+    free(hay);
+}
+
+/* Last match of any pattern, with one search per pattern. */
+static char const *last_of_each(find_last find, char const *hay, size_t n,
+                                char_ptr const *firsts, char_ptr const *lasts,
+                                size_t count, size_t *which) {
+    char const *last = hay + n;
+    size_t k;
+    *which = count;
+    for (k = 0; k < count; ++k) {
+        char const *found = find(hay, hay + n, firsts[k], lasts[k]);
+        if (found != hay + n && (last == hay + n || found > last)) {
+            last = found;
+            *which = k;
+        }
+    }
+    return last;
+}
+
+/*
+ * Last match of any of 1 to 100 patterns of 8 letters in 4 MB of random
+ * letters: find_last_of_subsequences, which only compares elements for
+ * equality like the Boyer-Moore search, against a Boyer-Moore search per
+ * pattern and a byte search per pattern. One of the patterns occurs near
+ * the front and the others nowhere, so that the whole haystack is searched.
+ */
+static void bench_patterns(void) {
+    size_t const n = (size_t)1 << 22, m = 8;
+    size_t const counts[] = { 1, 3, 10, 30, 100 };
+    char *hay = random_letters(n);
+    char const *planted = plant_needle(hay, 4096);
+    char *letters = random_letters(100 * m);
+    char_ptr firsts[100], lasts[100];
+    size_t c, k;
+
+    for (k = 0; k < 100; ++k) {
+        letters[k * m] = 'A' + next_random() % 26;
+        firsts[k] = letters + k * m;
+        lasts[k] = firsts[k] + m;
+    }
+
+    for (c = 0; c < sizeof counts / sizeof counts[0]; ++c) {
+        size_t const count = counts[c], planted_at = count / 2;
+        char const *one_pass, *boyer_moore, *bytes;
+        size_t one_pass_which, boyer_moore_which, bytes_which;
+        double start, one_pass_s, boyer_moore_s, bytes_s;
+
+        firsts[planted_at] = planted;
+        lasts[planted_at] = planted + m;
+
+        start = now();
+        one_pass = nstl_find_last_of_subsequences(char_ptr, char_ptr)(
+            hay, hay + n, firsts, lasts, count, &one_pass_which);
+        one_pass_s = now() - start;
+        boyer_moore = last_of_each(
+            nstl_find_last_subsequence(char_random, char_random),
+            hay, n, firsts, lasts, count, &boyer_moore_which);
+        boyer_moore_s = now() - start - one_pass_s;
+        bytes = last_of_each(nstl_find_last_subsequence(char_ptr, char_ptr),
+                             hay, n, firsts, lasts, count, &bytes_which);
+        bytes_s = now() - start - one_pass_s - boyer_moore_s;
+
+        check(one_pass == planted && boyer_moore == planted &&
+              bytes == planted && one_pass_which == planted_at &&
+              boyer_moore_which == planted_at && bytes_which == planted_at,
+              "patterns: planted pattern found");
+        printf("%3u patterns: one pass %7.2f, Boyer-Moore per pattern "
+               "%7.2f, byte search per pattern %7.2f ms\n", (unsigned)count,
+               one_pass_s * 1e3, boyer_moore_s * 1e3, bytes_s * 1e3);
+
+        firsts[planted_at] = letters + planted_at * m;
+        lasts[planted_at] = firsts[planted_at] + m;
+    }
+    free(letters);
+    free(hay);
+}
+
+
+int main(void) {
+    bench_needle_lengths();
+    bench_parallel();
+    bench_bidirectional();
+    bench_patterns();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
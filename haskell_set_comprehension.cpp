@@ -1,8 +1,15 @@
 
-// clang++ -std=c++11 -stdlib=libc++ -Wall -Wextra -pedantic -I/Users/louisdionne/Documents/Ordi/d3_ext_boost
+// clang++ -std=c++11 -stdlib=libc++ -Wall -Wextra -pedantic -O2 -I/Users/louisdionne/Documents/Ordi/d3_ext_boost
 
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <iostream>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 
@@ -15,86 +22,458 @@ namespace Haskell {
 
 struct Placeholder { };
 
-template <typename Collection>
+// Non-owning view of the elements of a collection, which must outlive it.
+template <typename Iterator>
 struct IterableExpression {
-    Collection collection_;
+    Iterator first_, last_;
+
+    IterableExpression(Iterator first, Iterator last)
+        : first_(first), last_(last)
+    { }
+
+    Iterator begin() const { return first_; }
+    Iterator end() const { return last_; }
+};
+
+namespace detail {
+template <std::size_t ...I> struct indices { };
+template <std::size_t N, std::size_t ...I>
+struct make_indices : make_indices<N - 1, N - 1, I...> { };
+template <std::size_t ...I>
+struct make_indices<0, I...> { typedef indices<I...> type; };
+
+template <std::size_t N> struct level { };
+
+template <typename ...> struct voider { typedef void type; };
+
+template <typename F, typename Args, typename = void>
+struct is_callable_with : std::false_type { };
+
+template <typename F, typename ...Args>
+struct is_callable_with<F, std::tuple<Args...>, typename voider<
+    decltype(std::declval<F const&>()(std::declval<Args>()...))
+>::type> : std::true_type { };
+
+// The first K types of a tuple.
+template <typename Tuple, typename Indices> struct select;
+template <typename Tuple, std::size_t ...I>
+struct select<Tuple, indices<I...> > {
+    typedef std::tuple<typename std::tuple_element<I, Tuple>::type...> type;
+};
+template <std::size_t K, typename Tuple>
+struct prefix : select<Tuple, typename make_indices<K>::type> { };
+
+// Number of generators whose variables a guard takes: the smallest K for
+// which it can be called with the variables of the first K generators, or
+// Max + 1 if there is none.
+template <typename Predicate, typename Values, std::size_t K, std::size_t Max,
+          bool = (K > Max)>
+struct guard_level : std::integral_constant<std::size_t, K> { };
+
+template <typename Predicate, typename Values, std::size_t K, std::size_t Max>
+struct guard_level<Predicate, Values, K, Max, false>
+    : std::conditional<
+        is_callable_with<Predicate, typename prefix<K, Values>::type>::value,
+        std::integral_constant<std::size_t, K>,
+        guard_level<Predicate, Values, K + 1, Max>
+    >::type
+{ };
+
+template <std::size_t Level, typename Predicate>
+struct Guard {
+    static std::size_t const level = Level;
+    Predicate pred_;
+};
+
+// [x | x <- xs] yields x and [(x, y) | x <- xs, y <- ys] yields (x, y).
+struct Identity {
+    template <typename T>
+    T&& operator()(T&& t) const { return std::forward<T>(t); }
+
+    template <typename T, typename U, typename ...More>
+    std::tuple<typename std::decay<T>::type, typename std::decay<U>::type,
+               typename std::decay<More>::type...>
+    operator()(T&& t, U&& u, More&& ...more) const {
+        return std::make_tuple(std::forward<T>(t), std::forward<U>(u),
+                               std::forward<More>(more)...);
+    }
+};
+
+// What a comprehension is made of: the range of each generator, the
+// transformation and the guards.
+template <typename Callable, typename Iterators, typename Guards>
+struct Comprehension;
+
+template <typename Callable, typename ...Iterators, typename ...Guards>
+struct Comprehension<Callable, std::tuple<Iterators...>, std::tuple<Guards...> > {
+    std::tuple<Iterators...> firsts_, lasts_;
+    Callable f_;
+    std::tuple<Guards...> guards_;
+};
+
+struct end_tag { };
+
+// Iterator over the results of a comprehension, i.e. over the combinations
+// of the elements of the generators that satisfy the guards, transformed
+// by f. It holds one iterator per generator and moves them like nested
+// loops would, the first generator being the outermost.
+//
+// A guard is checked as soon as the variables it takes are bound, in the
+// loop of the last of these generators: a guard on x only is checked once
+// per x, however many generators follow. Nothing is computed before it is
+// needed, so stopping early does not cost the results that are not used.
+template <typename Callable, typename Iterators, typename Guards>
+class FusedIterator;
+
+template <typename Callable, typename ...Iterators, typename ...Guards>
+class FusedIterator<Callable, std::tuple<Iterators...>, std::tuple<Guards...> > {
+    static std::size_t const generators = sizeof...(Iterators);
+    static std::size_t const guards = sizeof...(Guards);
+
+    typedef Comprehension<Callable, std::tuple<Iterators...>,
+                          std::tuple<Guards...> > comprehension;
+
+    comprehension c_;
+    std::tuple<Iterators...> its_;
+
+    template <typename F, std::size_t ...I>
+    auto call(F const& f, indices<I...>) const
+        -> decltype(f(*std::get<I>(its_)...))
+    { return f(*std::get<I>(its_)...); }
+
+    // Whether the guards taking the variables of the first K generators
+    // accept the current ones.
+    template <std::size_t K, std::size_t G>
+    bool check(level<K>, level<G>) const {
+        typedef typename std::tuple_element<G, std::tuple<Guards...> >::type
+                guard;
+        return check(std::get<G>(c_.guards_).pred_,
+                     std::integral_constant<bool, guard::level == K>(),
+                     typename make_indices<K>::type()) &&
+               check(level<K>(), level<G + 1>());
+    }
 
-    explicit IterableExpression(Collection const& val) : collection_(val) { }
+    template <std::size_t K>
+    bool check(level<K>, level<guards>) const { return true; }
+
+    template <typename Predicate, typename Indices>
+    bool check(Predicate const&, std::false_type, Indices) const
+    { return true; }
+
+    template <typename Predicate, std::size_t ...I>
+    bool check(Predicate const& pred, std::true_type, indices<I...> i) const
+    { return call(pred, i); }
+
+    // Moves the iterators of generators L and up to the first combination
+    // accepted by the guards, starting from the current element of
+    // generator L. Returns false if generator L runs out.
+    template <std::size_t L>
+    bool find(level<L>) {
+        for (; std::get<L>(its_) != std::get<L>(c_.lasts_); ++std::get<L>(its_)) {
+            if (check(level<L + 1>(), level<0>())) {
+                rewind(level<L + 1>());
+                if (find(level<L + 1>()))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool find(level<generators>) { return true; }
+
+    template <std::size_t L>
+    void rewind(level<L>) { std::get<L>(its_) = std::get<L>(c_.firsts_); }
+
+    void rewind(level<generators>) { }
+
+    // Moves to the next accepted combination of generators L and up.
+    template <std::size_t L>
+    bool step(level<L>) {
+        if (step(level<L + 1>()))
+            return true;
+        ++std::get<L>(its_);
+        return find(level<L>());
+    }
 
-    auto begin() const -> decltype(collection_.begin()) {
-        return collection_.begin();
+    bool step(level<generators>) { return false; }
+
+    // Whether the iterators of generators L and up are where b's are.
+    template <std::size_t L>
+    bool same(FusedIterator const& b, level<L>) const {
+        return std::get<L>(its_) == std::get<L>(b.its_) &&
+               same(b, level<L + 1>());
     }
 
-    auto begin() -> decltype(collection_.begin()) {
-        return collection_.begin();
+    bool same(FusedIterator const&, level<generators>) const { return true; }
+
+    // Past the last result, only the outermost iterator is known to be at
+    // the end of its generator. With a single generator, comparing it is
+    // enough.
+    bool equal(FusedIterator const& b, std::true_type) const
+    { return std::get<0>(its_) == std::get<0>(b.its_); }
+
+    bool equal(FusedIterator const& b, std::false_type) const {
+        return std::get<0>(its_) == std::get<0>(b.its_) &&
+               (std::get<0>(its_) == std::get<0>(c_.lasts_) ||
+                same(b, level<1>()));
     }
 
-    auto end() const -> decltype(collection_.end()) {
-        return collection_.end();
+public:
+    // Results are computed on each dereference, so there is nothing to
+    // point to: this is only an input iterator, and has no operator->.
+    typedef std::input_iterator_tag iterator_category;
+    typedef typename std::decay<
+        decltype(std::declval<Callable const&>()(
+                    *std::declval<Iterators>()...))
+    >::type value_type;
+    typedef value_type reference;
+    typedef void pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    // The first result.
+    explicit FusedIterator(comprehension const& c)
+        : c_(c), its_(c.firsts_)
+    { find(level<0>()); }
+
+    // Past the last result.
+    FusedIterator(comprehension const& c, end_tag)
+        : c_(c), its_(c.lasts_)
+    { }
+
+    reference operator*() const
+    { return call(c_.f_, typename make_indices<generators>::type()); }
+
+    FusedIterator& operator++() {
+        step(level<0>());
+        return *this;
     }
 
-    auto end() -> decltype(collection_.end()) {
-        return collection_.end();
+    FusedIterator operator++(int) {
+        FusedIterator tmp(*this);
+        ++*this;
+        return tmp;
     }
+
+    friend bool operator==(FusedIterator const& a, FusedIterator const& b)
+    { return a.equal(b, std::integral_constant<bool, generators == 1>()); }
+
+    friend bool operator!=(FusedIterator const& a, FusedIterator const& b)
+    { return !a.equal(b, std::integral_constant<bool, generators == 1>()); }
 };
 
+// Iterator over the first k results of another one, which is not moved
+// past the k-th result.
+template <typename Iterator>
+class TakeIterator {
+    Iterator it_, last_;
+    std::size_t left_;
 
-template <typename Callable, typename Collection>
-class TransformedIterableExpression : public IterableExpression<Collection> {
-    Callable f_;
-    using Base = IterableExpression<Collection>;
+    bool at_end() const { return left_ == 0 || it_ == last_; }
+
+public:
+    // At most a forward iterator, since it cannot be moved by more than one.
+    typedef typename std::common_type<
+        typename std::iterator_traits<Iterator>::iterator_category,
+        std::forward_iterator_tag
+    >::type iterator_category;
+    typedef typename std::iterator_traits<Iterator>::value_type value_type;
+    typedef typename std::iterator_traits<Iterator>::reference reference;
+    typedef void pointer;
+    typedef typename std::iterator_traits<Iterator>::difference_type
+            difference_type;
+
+    TakeIterator(Iterator it, Iterator last, std::size_t left)
+        : it_(it), last_(last), left_(left)
+    { }
+
+    reference operator*() const { return *it_; }
+
+    TakeIterator& operator++() {
+        if (--left_ != 0)
+            ++it_;
+        return *this;
+    }
+
+    TakeIterator operator++(int) {
+        TakeIterator tmp(*this);
+        ++*this;
+        return tmp;
+    }
+
+    friend bool operator==(TakeIterator const& a, TakeIterator const& b) {
+        return a.at_end() || b.at_end() ? a.at_end() == b.at_end()
+                                        : a.it_ == b.it_;
+    }
+
+    friend bool operator!=(TakeIterator const& a, TakeIterator const& b)
+    { return !(a == b); }
+};
+} // end namespace detail
+
+
+// [f(x, y, ...) | x <- xs, y <- ys, ..., guards]
+//
+// Generators are nested in the order they are written, and the variable
+// of each generator is passed positionally to f. A guard takes the
+// variables of the first generators, as many as needed to call it, and is
+// checked as soon as they are bound; for a guard on the inner variables
+// only, take the outer ones too and ignore them.
+template <typename Callable, typename Iterators,
+          typename Guards = std::tuple<> >
+class TransformedIterableExpression;
+
+template <typename Callable, typename ...Iterators, typename ...Guards>
+class TransformedIterableExpression<Callable, std::tuple<Iterators...>,
+                                    std::tuple<Guards...> > {
+    detail::Comprehension<Callable, std::tuple<Iterators...>,
+                          std::tuple<Guards...> > c_;
 
 public:
-    explicit TransformedIterableExpression(Callable const& f, Collection const& coll)
-        : Base(coll), f_(f)
+    typedef detail::FusedIterator<Callable, std::tuple<Iterators...>,
+                                  std::tuple<Guards...> > iterator;
+    typedef iterator const_iterator;
+
+    TransformedIterableExpression(Callable const& f,
+                                  std::tuple<Iterators...> const& firsts,
+                                  std::tuple<Iterators...> const& lasts,
+                                  std::tuple<Guards...> const& guards)
+        : c_{firsts, lasts, f, guards}
     { }
 
-    boost::transform_iterator<Callable,
+    iterator begin() const { return iterator(c_); }
+    iterator end() const { return iterator(c_, detail::end_tag()); }
+
+    template <typename Iterator>
+    TransformedIterableExpression<Callable,
+                                  std::tuple<Iterators..., Iterator>,
+                                  std::tuple<Guards...> >
+    generator(IterableExpression<Iterator> const& source) const {
+        return TransformedIterableExpression<Callable,
+                                             std::tuple<Iterators..., Iterator>,
+                                             std::tuple<Guards...> >(
+            c_.f_, std::tuple_cat(c_.firsts_, std::make_tuple(source.begin())),
+            std::tuple_cat(c_.lasts_, std::make_tuple(source.end())), c_.guards_);
+    }
+
+    template <typename Predicate>
+    struct with_guard {
+        typedef detail::Guard<detail::guard_level<
+            Predicate,
+            std::tuple<typename std::iterator_traits<Iterators>::reference...>,
+            1, sizeof...(Iterators)
+        >::value, Predicate> guard;
+        typedef TransformedIterableExpression<Callable,
+                                              std::tuple<Iterators...>,
+                                              std::tuple<Guards..., guard> >
+                type;
+    };
+
+    template <typename Predicate>
+    typename with_guard<Predicate>::type
+    guarded(Predicate const& pred) const {
+        typedef typename with_guard<Predicate>::guard guard;
+        static_assert(guard::level <= sizeof...(Iterators),
+            "a guard must be callable with the variables of the generators "
+            "before it");
+        guard const g = { pred };
+        return typename with_guard<Predicate>::type(
+            c_.f_, c_.firsts_, c_.lasts_,
+            std::tuple_cat(c_.guards_, std::make_tuple(g)));
+    }
 };
 
-template <typename Predicate, typename Collection>
-struct FilteredExpression : IterableExpression<Collection> {
-    using Base = IterableExpression<Collection>;
-    Predicate pred_;
+// [x | x <- collection, pred(x)]
+template <typename Predicate, typename Iterator>
+using FilteredExpression = TransformedIterableExpression<
+    detail::Identity, std::tuple<Iterator>,
+    std::tuple<detail::Guard<1, Predicate> >
+>;
 
-    explicit FilteredExpression(Predicate const& pred, Collection const& coll)
-        : Base(coll), pred_(pred)
+// take k xs: the first k results of a comprehension, which stops looking
+// for results after the k-th one.
+template <typename Expression>
+class TakeExpression {
+    Expression expr_;
+    std::size_t k_;
+
+public:
+    typedef detail::TakeIterator<typename Expression::const_iterator> iterator;
+    typedef iterator const_iterator;
+
+    TakeExpression(std::size_t k, Expression const& expr)
+        : expr_(expr), k_(k)
     { }
+
+    iterator begin() const { return iterator(expr_.begin(), expr_.end(), k_); }
+    iterator end() const { return iterator(expr_.end(), expr_.end(), 0); }
 };
 
+template <typename Expression>
+TakeExpression<Expression> take(std::size_t k, Expression const& expr) {
+    return TakeExpression<Expression>(k, expr);
+}
+
 namespace detail {
 template <typename Collection>
 struct PreAssignWrapper {
-    Collection collection_;
+    Collection const& collection_;
 
     explicit PreAssignWrapper(Collection const& coll) : collection_(coll) { }
-
-    operator Collection() const {
-        return collection_;
-    }
 };
+
+// Result, for collections only, so that unary minus on other types is left
+// alone.
+template <typename Collection, typename Result,
+          typename = typename Collection::const_iterator>
+struct if_collection { typedef Result type; };
 } // end namespace detail
 
 
 
-template <typename Callable, typename Collection>
-TransformedIterableExpression<Callable, Collection> operator|(Callable f, IterableExpression<Collection> it) {
-    return TransformedIterableExpression<Callable, Collection>(f, it.collection_);
+template <typename Callable, typename Iterator>
+TransformedIterableExpression<Callable, std::tuple<Iterator> > operator|(Callable f, IterableExpression<Iterator> it) {
+    return TransformedIterableExpression<Callable, std::tuple<Iterator> >(
+        f, std::make_tuple(it.begin()), std::make_tuple(it.end()), std::tuple<>());
 }
 
-template <typename Collection, typename Predicate>
-FilteredExpression<Predicate, IterableExpression<Collection>> operator,(IterableExpression<Collection> coll, Predicate pred) {
-    return FilteredExpression<Predicate, IterableExpression<Collection>>(pred, coll);
-}
+template <typename Iterator, typename Predicate>
+auto operator,(IterableExpression<Iterator> it, Predicate pred)
+    -> decltype((detail::Identity() | it).guarded(pred))
+{ return (detail::Identity() | it).guarded(pred); }
+
+template <typename Iterator1, typename Iterator2>
+auto operator,(IterableExpression<Iterator1> it1, IterableExpression<Iterator2> it2)
+    -> decltype((detail::Identity() | it1).generator(it2))
+{ return (detail::Identity() | it1).generator(it2); }
+
+template <typename Callable, typename Iterators, typename Guards, typename Predicate>
+auto operator,(TransformedIterableExpression<Callable, Iterators, Guards> const& expr, Predicate pred)
+    -> decltype(expr.guarded(pred))
+{ return expr.guarded(pred); }
 
+template <typename Callable, typename Iterators, typename Guards, typename Iterator>
+auto operator,(TransformedIterableExpression<Callable, Iterators, Guards> const& expr, IterableExpression<Iterator> it)
+    -> decltype(expr.generator(it))
+{ return expr.generator(it); }
+
+// The expression only refers to the collection, which must outlive it:
+// `_1 <- make_vector()` would dangle, so it does not compile.
 template <typename Collection>
-detail::PreAssignWrapper<Collection> operator-(Collection const& coll) {
+typename detail::if_collection<
+    Collection, detail::PreAssignWrapper<Collection>
+>::type operator-(Collection const& coll) {
     return detail::PreAssignWrapper<Collection>(coll);
 }
 
 template <typename Collection>
-IterableExpression<Collection> operator<(Placeholder, detail::PreAssignWrapper<Collection> coll) {
-    return IterableExpression<Collection>(coll);
+typename detail::if_collection<Collection, void>::type
+operator-(Collection const&&) = delete;
+
+template <typename Collection>
+IterableExpression<typename Collection::const_iterator>
+operator<(Placeholder, detail::PreAssignWrapper<Collection> coll) {
+    return IterableExpression<typename Collection::const_iterator>(
+                    coll.collection_.begin(), coll.collection_.end());
 }
 
 // goal is to write:
@@ -102,21 +481,144 @@ IterableExpression<Collection> operator<(Placeholder, detail::PreAssignWrapper<C
 
 inline int add2(int i) { return i + 2; }
 inline bool is_odd(int i) { return i % 2 != 0; }
+inline bool sum_divisible_by3(int x, int y) { return (x + y) % 3 == 0; }
+inline long long times(int x, int y) { return static_cast<long long>(x) * y; }
+
+
+// Sums [add2 x | x <- v, odd x] with the comprehension and with the loop it
+// should compile down to, keeping the best of a few runs of each. Half of
+// the values are odd at random, so either side is several times faster
+// when the compiler makes the guard branchless, which depends on the
+// optimization level: compare both at -O2 and -O3.
+void benchmark() {
+    std::size_t const n = 10000000;
+    std::vector<int> v(n);
+    for (std::size_t i = 0; i < n; ++i)
+        v[i] = static_cast<int>(i * 2654435761u % 1000);
+    Placeholder _1;
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double, std::milli> milliseconds;
+
+    double hand = 1e9, dsl = 1e9;
+    long long by_hand = 0, comprehension = 0;
+    for (int run = 0; run < 5; ++run) {
+        clock::time_point start = clock::now();
+        by_hand = 0;
+        for (std::size_t i = 0; i < v.size(); ++i)
+            if (is_odd(v[i]))
+                by_hand += add2(v[i]);
+        hand = std::min(hand, milliseconds(clock::now() - start).count());
+
+        start = clock::now();
+        comprehension = 0;
+        for (int i: (add2 | (_1 <- v), is_odd))
+            comprehension += i;
+        dsl = std::min(dsl, milliseconds(clock::now() - start).count());
+    }
+
+    std::cout << "hand-written loop: " << hand << " ms, "
+              << "comprehension: " << dsl << " ms"
+              << (by_hand == comprehension ? "" : " (results differ!)")
+              << std::endl;
+}
+
+// Sums [x * y | x <- xs, odd x, y <- ys, (x + y) `mod` 3 == 0] and its first
+// few results lazily, against nested loops that build the whole result
+// first, keeping the best of a few runs of each.
+void benchmark_nested() {
+    std::size_t const n = 3000, k = 10;
+    std::vector<int> xs(n), ys(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        xs[i] = static_cast<int>(i * 2654435761u % 1000);
+        ys[i] = static_cast<int>(i * 40503u % 1000);
+    }
+    Placeholder _1, _2;
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double, std::milli> milliseconds;
+
+    double eager = 1e9, lazy = 1e9, eager_take = 1e9, lazy_take = 1e9;
+    long long eager_sum = 0, lazy_sum = 0, eager_take_sum = 0, lazy_take_sum = 0;
+    for (int run = 0; run < 5; ++run) {
+        clock::time_point start = clock::now();
+        std::vector<long long> all;
+        for (std::size_t i = 0; i < xs.size(); ++i)
+            for (std::size_t j = 0; j < ys.size(); ++j)
+                if (is_odd(xs[i]) && sum_divisible_by3(xs[i], ys[j]))
+                    all.push_back(times(xs[i], ys[j]));
+        eager_sum = 0;
+        for (std::size_t i = 0; i < all.size(); ++i)
+            eager_sum += all[i];
+        eager = std::min(eager, milliseconds(clock::now() - start).count());
+
+        start = clock::now();
+        lazy_sum = 0;
+        for (long long p: (times | (_1 <- xs), is_odd, _2 <- ys, sum_divisible_by3))
+            lazy_sum += p;
+        lazy = std::min(lazy, milliseconds(clock::now() - start).count());
+
+        start = clock::now();
+        all.clear();
+        for (std::size_t i = 0; i < xs.size(); ++i)
+            for (std::size_t j = 0; j < ys.size(); ++j)
+                if (is_odd(xs[i]) && sum_divisible_by3(xs[i], ys[j]))
+                    all.push_back(times(xs[i], ys[j]));
+        eager_take_sum = 0;
+        for (std::size_t i = 0; i < std::min(k, all.size()); ++i)
+            eager_take_sum += all[i];
+        eager_take = std::min(eager_take,
+                              milliseconds(clock::now() - start).count());
+
+        start = clock::now();
+        lazy_take_sum = 0;
+        for (long long p: take(k, (times | (_1 <- xs), is_odd, _2 <- ys, sum_divisible_by3)))
+            lazy_take_sum += p;
+        lazy_take = std::min(lazy_take,
+                             milliseconds(clock::now() - start).count());
+    }
 
+    std::cout << "nested loops: " << eager << " ms, "
+              << "comprehension: " << lazy << " ms"
+              << (eager_sum == lazy_sum ? "" : " (results differ!)")
+              << std::endl;
+    std::cout << "take " << k << " of nested loops: " << eager_take << " ms, "
+              << "of comprehension: " << lazy_take << " ms"
+              << (eager_take_sum == lazy_take_sum ? "" : " (results differ!)")
+              << std::endl;
+}
 
 int main() {
     std::vector<int> v{0, 1, 2, 3, 4, 5};
-    Placeholder _1;
+    Placeholder _1, _2;
 
     auto iterable = _1 <- v;
     auto transformed = add2 | iterable;
     auto filtered = (transformed, is_odd);
 
-    auto filtered2 = (add2 | _1 <- v, is_odd);
+    auto filtered2 = (add2 | (_1 <- v), is_odd);
+
+    for (auto i: filtered)
+        std::cout << i << " ";
+    std::cout << std::endl;
 
     for (auto i: filtered2)
         std::cout << i << " ";
     std::cout << std::endl;
+
+    for (auto i: (_1 <- v, is_odd))
+        std::cout << i << " ";
+    std::cout << std::endl;
+
+    std::vector<int> w{1, 2, 3};
+    for (auto p: (_1 <- v, is_odd, _2 <- w, sum_divisible_by3))
+        std::cout << "(" << std::get<0>(p) << "," << std::get<1>(p) << ") ";
+    std::cout << std::endl;
+
+    for (auto i: take(2, (times | (_1 <- v), _2 <- w, sum_divisible_by3)))
+        std::cout << i << " ";
+    std::cout << std::endl;
+
+    benchmark();
+    benchmark_nested();
 }
 
 
@@ -19,6 +19,12 @@ extern "C" {
 #	include "eprintf.h"
 #endif
 
+#ifdef __cplusplus
+#	define KWARGS_RESTRICT_ __restrict
+#else
+#	define KWARGS_RESTRICT_ restrict
+#endif
+
 
 /*!	@warning	It is very important to be careful when using kwargs.
  *				Since they are implemented as compound literals, they become
@@ -38,21 +44,29 @@ struct kwargs_control_ {
  *	will have maximum aligment anyway. This way, we can use the offsetof
  *	macro to pass the arguments in and out of our implementation functions.
  */
+union kwargs_max_align_ {
+	char c;
+	short s;
+	long l;
+	long long ll;
+	float f;
+	double d;
+	long double ld;
+	void *p;
+	void (*fp) ();
+};
+
+/*!	Every KWARGS_STRUCT_() has its content at the same offset as this. */
+struct kwargs_layout_ {
+	struct kwargs_control_ control;
+	union kwargs_max_align_ content;
+};
+
 #define KWARGS_STRUCT_(...) \
 	struct { \
 		struct kwargs_control_ control; \
 		union { \
-			union { \
-				char c; \
-				short s; \
-				long l; \
-				long long ll; \
-				float f; \
-				double d; \
-				long double ld; \
-				void *p; \
-				void (*fp) (); \
-			} max_align; \
+			union kwargs_max_align_ max_align; \
 			struct { \
 				/* avoid illegal empty struct */ \
 				CHAOS_PP_IF(NARG(__VA_ARGS__)) (__VA_ARGS__, char c;) \
@@ -64,27 +78,29 @@ struct kwargs_control_ {
  *	control structure.
  */
 
-#define KWARGS_IN_(args) ( (struct kwargs_control_ *) ((char *)(args) - offsetof(KWARGS_STRUCT_(), content.content)) )
+#define KWARGS_IN_(args) ( (struct kwargs_control_ *) ((char *)(args) - offsetof(struct kwargs_layout_, content)) )
 
 /*!	Skip the control structure at the beginning of the kwargs, giving direct
  *	access to the content of the arguments.
  */
-#define KWARGS_OUT_(args) ( (kwargs) ((char *)(args) + offsetof(KWARGS_STRUCT_(), content.content)) )
+#define KWARGS_OUT_(args) ( (kwargs) ((char *)(args) + offsetof(struct kwargs_layout_, content)) )
 
 
 /*!	Pass arguments using keywords.
  *	Usage :
- *		to_kwargs((Keyword1, type1, value1, ..., typeN, valueN),
+ *		to_kwargs((Keyword1, type1, value1, ..., typeN, valueN)
  *				   ...
  *				  (KeywordN, type1, value1, ..., typeN, valueN))
  * @internal	This only links the nodes together, the kw is hashed
  *					when the compound literal is created.
  */
+#ifndef __cplusplus
 #define to_kwargs(...) \
 	to_kwargs_I_(CHAOS_PP_SEQ_SIZE(__VA_ARGS__), (struct kwargs_control_* []){KWARGS_APPLY_SEQ_(KWARGS_FORMAT_, __VA_ARGS__)})
+#endif
 #define KWARGS_APPLY_SEQ_(macro, seq) \
 	CHAOS_PP_EXPR(CHAOS_PP_SEQ_FOR_EACH(macro, seq))
-static inline kwargs to_kwargs_I_ (unsigned n, struct kwargs_control_* args[n])
+static inline kwargs to_kwargs_I_ (unsigned n, struct kwargs_control_* args[])
 {
 	struct kwargs_control_ **i;
 	for (i = args; --n; ) {
@@ -106,8 +122,10 @@ static inline bool kwargs_kw_equality_ (char const *s1, char const *s2)
 }
 
 /*!	Retrieve arguments passed using to_kwargs(). */
+#ifndef __cplusplus
 #define from_kwargs(kw, args) from_kwargs_I_(STRINGIZE(kw), args)
-static inline kwargs from_kwargs_I_ (char const *restrict kw, kwargs args)
+#endif
+static inline kwargs from_kwargs_I_ (char const *KWARGS_RESTRICT_ kw, kwargs args)
 {
 	for (struct kwargs_control_ *i = KWARGS_IN_(args); i != NULL; i = i->next)
 		if (kwargs_kw_equality_(i->kw, kw))
@@ -188,5 +206,176 @@ static inline void kwargs_extend (kwargs existing, kwargs extension)
 
 #ifdef __cplusplus
 }
+
+/*!	C++ front end.
+ *	In C++, to_kwargs() creates a kwargs_pack_ whose type remembers every
+ *	keyword it contains. When the callee receives the pack
+ *	with its static type, from_kwargs() finds the keyword at compile time
+ *	and yields the address of a member of the pack; no string is ever
+ *	compared. When the pack decays to a plain kwargs, the control nodes are
+ *	linked together and from_kwargs() falls back to the runtime lookup.
+ *	Usage :
+ *		template <typename Kwargs>
+ *		void callee (Kwargs &&args)
+ *		{
+ *			kwargs(type1 name1, ..., typeN nameN) identifier;
+ *			identifier = from_kwargs(Keyword, args); // static lookup
+ *		}
+ *		void c_callee (kwargs args); // runtime lookup
+ */
+#include <cstddef>
+
+/*!	A keyword as a type: its characters, padded with '\0' up to
+ *	KWARGS_KW_MAX_ characters. Two keywords have the same type exactly when
+ *	they are spelled the same, so the static lookup never mistakes one
+ *	keyword for another.
+ */
+template <char ...Chars>
+struct kwargs_kw_ { };
+
+#define KWARGS_KW_MAX_ 32
+
+template <bool Fits>
+struct kwargs_kw_check_ {
+	static_assert(Fits, "kwargs keywords are limited to 32 characters");
+
+	template <char ...Chars>
+	struct apply { typedef kwargs_kw_<Chars...> type; };
+};
+
+/*!	The type of a keyword, from its name. */
+#define KWARGS_KW_(kw) KWARGS_KW_I_(STRINGIZE(kw))
+#define KWARGS_KW_I_(s) \
+	typename kwargs_kw_check_<(sizeof(s) <= KWARGS_KW_MAX_ + 1)>::template apply< \
+		KWARGS_KW_C_(s, 0), KWARGS_KW_C_(s, 1), KWARGS_KW_C_(s, 2), KWARGS_KW_C_(s, 3), \
+		KWARGS_KW_C_(s, 4), KWARGS_KW_C_(s, 5), KWARGS_KW_C_(s, 6), KWARGS_KW_C_(s, 7), \
+		KWARGS_KW_C_(s, 8), KWARGS_KW_C_(s, 9), KWARGS_KW_C_(s, 10), KWARGS_KW_C_(s, 11), \
+		KWARGS_KW_C_(s, 12), KWARGS_KW_C_(s, 13), KWARGS_KW_C_(s, 14), KWARGS_KW_C_(s, 15), \
+		KWARGS_KW_C_(s, 16), KWARGS_KW_C_(s, 17), KWARGS_KW_C_(s, 18), KWARGS_KW_C_(s, 19), \
+		KWARGS_KW_C_(s, 20), KWARGS_KW_C_(s, 21), KWARGS_KW_C_(s, 22), KWARGS_KW_C_(s, 23), \
+		KWARGS_KW_C_(s, 24), KWARGS_KW_C_(s, 25), KWARGS_KW_C_(s, 26), KWARGS_KW_C_(s, 27), \
+		KWARGS_KW_C_(s, 28), KWARGS_KW_C_(s, 29), KWARGS_KW_C_(s, 30), KWARGS_KW_C_(s, 31) \
+	>::type
+#define KWARGS_KW_C_(s, i) ((i) < sizeof(s) ? (s)[(i)] : '\0')
+
+/*!	Layout of a single keyword. The content is placed exactly where the C
+ *	implementation would put it, so that a linked pack can be handed to
+ *	from_kwargs_I_() and kwargs_extend().
+ */
+template <typename Keyword, typename Content>
+struct kwargs_group_ {
+	struct kwargs_control_ control;
+	alignas(union kwargs_max_align_) Content content;
+};
+
+template <typename ...Groups>
+struct kwargs_pack_;
+
+template <>
+struct kwargs_pack_<> {
+	struct kwargs_control_ *first () { return NULL; }
+	void link () { }
+};
+
+template <typename Group, typename ...Groups>
+struct kwargs_pack_<Group, Groups...> {
+	static_assert(offsetof(Group, content) == offsetof(kwargs_layout_, content),
+				  "kwargs content must be laid out like the C implementation");
+
+	Group head;
+	kwargs_pack_<Groups...> tail;
+
+	struct kwargs_control_ *first () { return &head.control; }
+
+	/*!	Link the control nodes, as to_kwargs_I_() does in C. */
+	void link ()
+	{
+		head.control.next = tail.first();
+		tail.link();
+	}
+
+	/*!	Decay to the runtime representation. */
+	operator void * ()
+	{
+		link();
+		return &head.content;
+	}
+};
+
+/*!	Append a keyword to a pack; used to build the pack from left to right. */
+template <typename New>
+inline kwargs_pack_<New> operator+ (kwargs_pack_<>, New const &group)
+{ return kwargs_pack_<New>{group, {}}; }
+
+template <typename Group, typename ...Groups, typename New>
+inline kwargs_pack_<Group, Groups..., New>
+operator+ (kwargs_pack_<Group, Groups...> const &pack, New const &group)
+{ return kwargs_pack_<Group, Groups..., New>{pack.head, pack.tail + group}; }
+
+/*!	Compile-time lookup. The first matching keyword wins, like the runtime
+ *	lookup. A missing keyword yields NULL, like the runtime lookup.
+ */
+template <typename Keyword>
+inline void *kwargs_static_find_ (kwargs_pack_<> &)
+{ return NULL; }
+
+template <typename Keyword, typename Content, typename ...Groups>
+inline void *kwargs_static_find_ (kwargs_pack_<kwargs_group_<Keyword, Content>, Groups...> &pack)
+{ return &pack.head.content; }
+
+template <typename Keyword, typename Group, typename ...Groups>
+inline void *kwargs_static_find_ (kwargs_pack_<Group, Groups...> &pack)
+{ return kwargs_static_find_<Keyword>(pack.tail); }
+
+/*!	C++ does not convert void * implicitly to other pointer types, so the
+ *	result of from_kwargs() converts to whatever the callee asks for.
+ */
+struct kwargs_result_ {
+	void *ptr;
+
+	template <typename T>
+	operator T * () const { return static_cast<T *>(ptr); }
+};
+
+template <typename Keyword>
+inline kwargs_result_ kwargs_from_ (char const *kw, kwargs args)
+{ return kwargs_result_{from_kwargs_I_(kw, args)}; }
+
+template <typename Keyword, typename ...Groups>
+inline kwargs_result_ kwargs_from_ (char const *kw, kwargs_pack_<Groups...> &args)
+{
+	void *found = kwargs_static_find_<Keyword>(args);
+#ifdef DEBUG
+	if (found == NULL)
+		eprintf("Invalid keyword : %s", kw);
+#else
+	(void)kw;
+#endif
+	return kwargs_result_{found};
+}
+
+/*!	Retrieve arguments passed using to_kwargs(). */
+#define from_kwargs(kw, args) \
+	kwargs_from_<KWARGS_KW_(kw)>(STRINGIZE(kw), args)
+
+/*!	Pass arguments using keywords; see the C version for the usage. */
+#define to_kwargs(...) \
+	(kwargs_pack_<>() KWARGS_APPLY_SEQ_(KWARGS_FORMAT_CXX_, __VA_ARGS__))
+
+/*!	Each keyword becomes a kwargs_group_ whose content is a local struct
+ *	holding the values. The struct has to be defined inside a lambda, since
+ *	C++ does not allow defining types in an expression.
+ */
+#define KWARGS_FORMAT_CXX_(_, ...) \
+	KWARGS_FORMAT_CXX_I_(CHAOS_PP_TUPLE_ELEM_ALT(0, (__VA_ARGS__)), CHAOS_PP_TUPLE_DROP(1, (__VA_ARGS__)))
+#define KWARGS_FORMAT_CXX_I_(kw_, types_values) \
+	+ [&] { \
+		struct content_ { \
+			KWARGS_APPLY_TUPLE_(KWARGS_FORMAT_ARGTYPE_, types_values) \
+		}; \
+		typedef kwargs_group_<KWARGS_KW_(kw_), content_> group_; \
+		return group_{{NULL, STRINGIZE(kw_)}, \
+					  content_{KWARGS_APPLY_TUPLE_(KWARGS_FORMAT_ARGVALUE_, types_values)}}; \
+	}()
 #endif
 #endif /* !KWARGS_H */
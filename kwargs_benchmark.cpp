@@ -0,0 +1,71 @@
+/*!
+ * @file
+ * Benchmark of the C++ front end of kwargs.h against the runtime lookup.
+ *
+ * Build and run :
+ *		g++ -std=c++11 -O2 kwargs_benchmark.cpp -o kwargs_benchmark
+ *		./kwargs_benchmark
+ *
+ * Generated code check : with the pack's static type, every from_kwargs()
+ * in static_lookup() must fold to an address inside the pack, so the
+ * function must contain neither a call nor a loop. This prints nothing when
+ * the check passes :
+ *		g++ -std=c++11 -O2 -S -o - kwargs_benchmark.cpp | c++filt \
+ *			| awk '/^double static_lookup.*:$/,/\.cfi_endproc/' \
+ *			| grep -E '\s(call|j[a-z]+)\s'
+ */
+
+#include "kwargs.h"
+#include <chrono>
+#include <cstdio>
+
+
+struct point { double x, y; };
+
+template <typename Kwargs>
+__attribute__((noinline)) double static_lookup (Kwargs &args)
+{
+	kwargs(int count) c = from_kwargs(count, args);
+	kwargs(double scale, double offset) a = from_kwargs(affine, args);
+	kwargs(point origin) o = from_kwargs(origin_of_the_plane, args);
+	return c->count * a->scale + a->offset + o->origin.x;
+}
+
+__attribute__((noinline)) double runtime_lookup (kwargs args)
+{
+	kwargs(int count) c = from_kwargs(count, args);
+	kwargs(double scale, double offset) a = from_kwargs(affine, args);
+	kwargs(point origin) o = from_kwargs(origin_of_the_plane, args);
+	return c->count * a->scale + a->offset + o->origin.x;
+}
+
+template <typename F>
+static void measure (char const *name, F f)
+{
+	unsigned const iterations = 50000000;
+	double sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned i = 0; i < iterations; ++i)
+		sum += f(i);
+	auto stop = std::chrono::steady_clock::now();
+	std::printf("%-8s %6.2f ns/call (sum %g)\n", name,
+		std::chrono::duration<double, std::nano>(stop - start).count() / iterations,
+		sum);
+}
+
+int main ()
+{
+	point const origin = {1.0, 2.0};
+	auto args = to_kwargs((count, int, 3)
+						  (affine, double, 2.0, double, 0.5)
+						  (origin_of_the_plane, point, origin));
+
+	measure("static", [&](unsigned i) {
+		args.head.content.kwargs_unique0 = i & 7;
+		return static_lookup(args);
+	});
+	measure("runtime", [&](unsigned i) {
+		args.head.content.kwargs_unique0 = i & 7;
+		return runtime_lookup(args);
+	});
+}
@@ -11,85 +11,1939 @@
 
 // The basic idea is that you have a bunch of keys stored in one object of type A:
 
-struct A{
-   vector<Key> keys;
-};
+//    struct A{
+//       vector<Key> keys;
+//    };
 
 // and then you have multiple objects of type B that each have to associate
 // data with each key stored in A. you could use:
 
-struct B{
-   map<Key, Data> data;
-};
+//    struct B{
+//       map<Key, Data> data;
+//    };
 
 // but since A::keys already provides a contiguous index for the keys you can
 // just as well store the data in B in a vector with matching indexes, and
 // make sure that the indexes used in A::keys don't change:
 
-struct A{
-   vector<Key> keys;
-   vector<std::size_t> freelist;
-   map<Key, std::size_t> index;
-
-   void erase(...){ push index of unused key to freelist; }
-   void push_back(Key){ reuse a freelist entry or keys.push_back; }
-};
+//    struct A{
+//       vector<Key> keys;
+//       vector<std::size_t> freelist;
+//       map<Key, std::size_t> index;
+//
+//       void erase(...){ push index of unused key to freelist; }
+//       void push_back(Key){ reuse a freelist entry or keys.push_back; }
+//    };
 
-struct B{
-   vector<optional<Data> > data;
-};
+//    struct B{
+//       vector<optional<Data> > data;
+//    };
 
 // keep in mind that there is one object A for many objects B. you can now
 // access the associated data of many objects B by looking up the index once
 // in object A, and by wasting some space in B::data for unused entries:
 
-b.data[a.index[key]]
+//    b.data[a.index[key]]
 
 // If Data is a pointer or any other type that knows an empty() state, you can
 // also get rid of optional<> and generalize it as two template like:
 
-template<class Key>
-class index;
+//    template<class Key>
+//    class index;
 
-template<class Mapped, class OptionalTraits = boost_optional_traits>
-class vector_map;
+//    template<class Mapped, class OptionalTraits = boost_optional_traits>
+//    class vector_map;
 
 
 
 //////////////////////////////////////////////////////////////////////////////
 
-template <typename Key>
+#include <boost/assert.hpp>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace shared_index_detail {
+    inline void prefetch(void const* p) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(p);
+#else
+        (void)p;
+#endif
+    }
+
+    // Something whose storage is laid out by the indices of a SharedIndex,
+    // and which must follow along when the index renumbers its keys.
+    // remap(object, to, span) is called with to[i] the new index of old
+    // index i, or -1 if i was not live; new indices keep the order of the
+    // old ones and are below span. release(object, i) is called when the
+    // key at index i is erased, before i can be handed out to another key.
+    struct dependent {
+        void* object;
+        void (*remap)(void* object, std::vector<std::size_t> const& to,
+                      std::size_t span);
+        void (*release)(void* object, std::size_t index);
+    };
+
+    // The dependents registered with an index. Copies of an index start
+    // with no dependents, since those refer to the original.
+    //
+    // Dependents are attached and detached through a const index, so
+    // attach() and detach() are serialized by a mutex and may be called
+    // from any number of threads, like the other const members. remap()
+    // and release() hold it too, since ConcurrentSharedIndex::erase() runs
+    // alongside const members.
+    class dependent_list {
+    public:
+        dependent_list() { }
+        dependent_list(dependent_list const&) { }
+        dependent_list& operator=(dependent_list const&) { return *this; }
+
+        void attach(dependent const& d) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            list_.push_back(d);
+        }
+        void detach(void* object) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < list_.size(); ++i)
+                if (list_[i].object == object) {
+                    list_[i] = list_.back();
+                    list_.pop_back();
+                    return;
+                }
+        }
+
+        // Each dependent is permuted on its own, so they are simply dealt
+        // out to up to `threads` threads in a round robin.
+        void remap(std::vector<std::size_t> const& to, std::size_t span,
+                   std::size_t threads) const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::size_t const n = list_.size();
+            if (threads > n)
+                threads = n;
+            if (threads <= 1) {
+                for (std::size_t d = 0; d < n; ++d)
+                    list_[d].remap(list_[d].object, to, span);
+                return;
+            }
+
+            std::vector<std::thread> workers;
+            for (std::size_t t = 0; t < threads; ++t)
+                workers.push_back(std::thread([this, &to, span, t, threads, n] {
+                    for (std::size_t d = t; d < n; d += threads)
+                        list_[d].remap(list_[d].object, to, span);
+                }));
+            for (std::size_t t = 0; t < threads; ++t)
+                workers[t].join();
+        }
+
+        void release(std::size_t index) const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < list_.size(); ++i)
+                list_[i].release(list_[i].object, index);
+        }
+
+    private:
+        mutable std::mutex mutex_;
+        std::vector<dependent> list_;
+    };
+
+    struct snapshot_access;
+} // end namespace shared_index_detail
+
+
+// Open addressing table mapping keys to stable indices. Indices of erased
+// keys go to a freelist and are handed out again by later insertions, so
+// the indices in use stay dense and never move.
+template <typename Key, typename Hash = boost::hash<Key>,
+                        typename Pred = std::equal_to<Key> >
 struct SharedIndex {
     typedef Key key_type;
     typedef std::size_t mapped_type;
 
+    static mapped_type const npos = static_cast<mapped_type>(-1);
+
+    explicit SharedIndex(Hash const& hash = Hash(), Pred const& pred = Pred())
+        : hash_(hash), pred_(pred), size_(0), used_(0)
+    { }
+
+    // Returns the index of key, inserting it if it is not there yet.
     mapped_type operator[](key_type const& key) {
-        return indices_[key];
+        return insert(key);
+    }
+
+    mapped_type insert(key_type const& key) {
+        if ((used_ + 1) * 2 > slots_.size())
+            rehash(slots_.size() == 0 ? 16 : (size_ + 1) * 4);
+
+        std::size_t const h = hash_(key);
+        std::size_t reuse = slots_.size();
+        for (std::size_t i = h & mask(); ; i = (i + 1) & mask()) {
+            slot& s = slots_[i];
+            if (s.index == vacant) {
+                if (reuse == slots_.size()) {
+                    reuse = i;
+                    ++used_;
+                }
+                break;
+            }
+            if (s.index == tombstone) {
+                if (reuse == slots_.size())
+                    reuse = i;
+            }
+            else if (s.hash == h && pred_(keys_[s.index], key))
+                return s.index;
+        }
+
+        mapped_type index;
+        if (freelist_.empty()) {
+            index = keys_.size();
+            keys_.push_back(key);
+            live_.push_back(true);
+        }
+        else {
+            index = freelist_.back();
+            freelist_.pop_back();
+            keys_[index] = key;
+            live_[index] = true;
+        }
+        slots_[reuse].hash = h;
+        slots_[reuse].index = index;
+        ++size_;
+        return index;
+    }
+
+    // Returns the index of key, or npos if it is not there.
+    mapped_type find(key_type const& key) const {
+        if (size_ == 0)
+            return npos;
+        std::size_t const* s = lookup(key, hash_(key));
+        return s ? *s : npos;
+    }
+
+    // Removes key and makes its index available for reuse. Attached
+    // dependents drop what they hold at that index, so the next key to get
+    // it starts out with no values.
+    bool erase(key_type const& key) {
+        if (size_ == 0)
+            return false;
+        std::size_t* s = lookup(key, hash_(key));
+        if (!s)
+            return false;
+        dependents_.release(*s);
+        live_[*s] = false;
+        freelist_.push_back(*s);
+        *s = tombstone;
+        --size_;
+        return true;
+    }
+
+    key_type const& key(mapped_type index) const {
+        BOOST_ASSERT(contains(index));
+        return keys_[index];
+    }
+
+    bool contains(mapped_type index) const {
+        return index < live_.size() && live_[index];
+    }
+
+    // Number of keys.
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Indices in use are always below span().
+    mapped_type span() const { return keys_.size(); }
+
+    // Renumbers the keys into [0, size()), keeping their relative order, and
+    // has every attached dependent permute its storage to match. Dependents
+    // are remapped by up to `threads` threads. Returns the number of indices
+    // reclaimed, i.e. by how much span() shrank.
+    std::size_t compact(std::size_t threads = 1) {
+        std::size_t const old_span = keys_.size();
+        if (size_ == old_span)
+            return 0;
+
+        std::vector<std::size_t> to(old_span, npos);
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < old_span; ++i) {
+            if (!live_[i])
+                continue;
+            to[i] = next;
+            if (i != next)
+                std::swap(keys_[next], keys_[i]);
+            ++next;
+        }
+        BOOST_ASSERT(next == size_);
+        keys_.resize(size_);
+        keys_.shrink_to_fit();
+        live_.assign(size_, true);
+        live_.shrink_to_fit();
+        std::vector<mapped_type>().swap(freelist_);
+
+        for (std::size_t i = 0; i < slots_.size(); ++i)
+            if (slots_[i].index != vacant && slots_[i].index != tombstone)
+                slots_[i].index = to[slots_[i].index];
+        rehash(size_ * 4);
+
+        dependents_.remap(to, size_, threads);
+        return old_span - size_;
+    }
+
+    // Registers d to be remapped by compact() and released by erase().
+    // IndexedContent does this by itself; d.object must be detached before
+    // it is destroyed. Both are safe to call concurrently with each other
+    // and with the other const members.
+    void attach(shared_index_detail::dependent const& d) const {
+        dependents_.attach(d);
+    }
+
+    void detach(void* object) const {
+        dependents_.detach(object);
+    }
+
+private:
+    static mapped_type const vacant = npos;
+    static mapped_type const tombstone = npos - 1;
+
+    struct slot {
+        std::size_t hash;
+        mapped_type index;
+    };
+
+    std::size_t mask() const { return slots_.size() - 1; }
+
+    // Address of the index stored for key, or null.
+    std::size_t const* lookup(key_type const& key, std::size_t h) const {
+        for (std::size_t i = h & mask(); ; i = (i + 1) & mask()) {
+            slot const& s = slots_[i];
+            if (s.index == vacant)
+                return 0;
+            if (s.index != tombstone && s.hash == h &&
+                pred_(keys_[s.index], key))
+                return &s.index;
+        }
+    }
+
+    std::size_t* lookup(key_type const& key, std::size_t h) {
+        return const_cast<std::size_t*>(
+            static_cast<SharedIndex const&>(*this).lookup(key, h));
+    }
+
+    // Grows to a power of two of at least n slots, dropping tombstones.
+    void rehash(std::size_t n) {
+        std::size_t capacity = 16;
+        while (capacity < n)
+            capacity *= 2;
+
+        std::vector<slot> old(capacity);
+        old.swap(slots_);
+        for (std::size_t i = 0; i < slots_.size(); ++i)
+            slots_[i].index = vacant;
+        for (std::size_t i = 0; i < old.size(); ++i) {
+            if (old[i].index == vacant || old[i].index == tombstone)
+                continue;
+            std::size_t j = old[i].hash & mask();
+            while (slots_[j].index != vacant)
+                j = (j + 1) & mask();
+            slots_[j] = old[i];
+        }
+        used_ = size_;
+    }
+
+    Hash hash_;
+    Pred pred_;
+    std::vector<slot> slots_;
+    std::vector<key_type> keys_;
+    std::vector<bool> live_;
+    std::vector<mapped_type> freelist_;
+    std::size_t size_; // live keys
+    std::size_t used_; // slots that are not vacant, tombstones included
+    mutable shared_index_detail::dependent_list dependents_;
+
+    friend struct shared_index_detail::snapshot_access;
+};
+
+template <typename Key, typename Hash, typename Pred>
+typename SharedIndex<Key, Hash, Pred>::mapped_type const
+SharedIndex<Key, Hash, Pred>::npos;
+
+template <typename Key, typename Hash, typename Pred>
+typename SharedIndex<Key, Hash, Pred>::mapped_type const
+SharedIndex<Key, Hash, Pred>::vacant;
+
+template <typename Key, typename Hash, typename Pred>
+typename SharedIndex<Key, Hash, Pred>::mapped_type const
+SharedIndex<Key, Hash, Pred>::tombstone;
+
+namespace shared_index_detail {
+    // Indices with attach() and detach() members take dependents; the
+    // others never renumber nor reuse their indices, and have no use for
+    // them.
+    template <typename Index>
+    auto attach(Index const& index, dependent const& d, int)
+        -> decltype(index.attach(d))
+    { index.attach(d); }
+
+    template <typename Index>
+    void attach(Index const&, dependent const&, long) { }
+
+    template <typename Index>
+    void attach(Index const& index, dependent const& d) {
+        attach(index, d, 0);
+    }
+
+    template <typename Index>
+    auto detach(Index const& index, void* object, int)
+        -> decltype(index.detach(object))
+    { index.detach(object); }
+
+    template <typename Index>
+    void detach(Index const&, void*, long) { }
+
+    template <typename Index>
+    void detach(Index const& index, void* object) {
+        detach(index, object, 0);
+    }
+} // end namespace shared_index_detail
+
+
+// Storage policies for IndexedContent. Both keep the values in one dense
+// array indexed like the SharedIndex; they differ in how they remember
+// which entries are present.
+
+// Presence is tracked in a separate bitmap, one bit per index, so any
+// default constructible T can be stored without padding per entry.
+template <typename T>
+struct bitmap_storage {
+    typedef T value_type;
+
+    std::size_t size() const { return values_.size(); }
+
+    void resize(std::size_t n) {
+        values_.resize(n);
+        bits_.resize((n + word_bits - 1) / word_bits, 0);
+    }
+
+    bool present(std::size_t i) const {
+        return (bits_[i / word_bits] >> (i % word_bits)) & 1;
+    }
+
+    T& get(std::size_t i) { return values_[i]; }
+    T const& get(std::size_t i) const { return values_[i]; }
+
+    // Hints that entry i is about to be read.
+    void prefetch(std::size_t i) const {
+        shared_index_detail::prefetch(&bits_[i / word_bits]);
+        shared_index_detail::prefetch(&values_[i]);
+    }
+
+    T& insert(std::size_t i) {
+        bits_[i / word_bits] |= word(1) << (i % word_bits);
+        return values_[i];
+    }
+
+    void erase(std::size_t i) {
+        bits_[i / word_bits] &= ~(word(1) << (i % word_bits));
+        values_[i] = T();
+    }
+
+    // Calls f(index, value) for each present entry, in index order.
+    template <typename F>
+    void for_each(F f) const {
+        for (std::size_t w = 0; w < bits_.size(); ++w)
+            for (word bits = bits_[w]; bits != 0; bits &= bits - 1) {
+                std::size_t const i = w * word_bits + lowest_bit(bits);
+                f(i, values_[i]);
+            }
+    }
+
+    std::size_t memory() const {
+        return values_.capacity() * sizeof(T) + bits_.capacity() * sizeof(word);
+    }
+
+    // Moves entry i to to[i] for every i below size(); see
+    // shared_index_detail::dependent.
+    void remap(std::vector<std::size_t> const& to, std::size_t span) {
+        std::vector<word> bits((span + word_bits - 1) / word_bits, 0);
+        std::size_t const n = std::min(values_.size(), to.size());
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t const j = to[i];
+            if (j == static_cast<std::size_t>(-1))
+                continue;
+            // Since j <= i, entry j was already moved away if it was live.
+            // Entries of dead keys were cleared by erase(), so whatever is
+            // swapped into i is already empty.
+            if (present(i))
+                bits[j / word_bits] |= word(1) << (j % word_bits);
+            if (j != i)
+                std::swap(values_[j], values_[i]);
+        }
+        bits_.swap(bits);
+        values_.resize(span);
+        values_.shrink_to_fit();
     }
 
 private:
-    typedef std::map<key_type, mapped_type> implementation_detail;
-    implementation_detail indices_;
+    typedef unsigned long long word;
+    static std::size_t const word_bits = sizeof(word) * CHAR_BIT;
+
+    static std::size_t lowest_bit(word bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(bits);
+#else
+        std::size_t n = 0;
+        for (; !(bits & 1); bits >>= 1)
+            ++n;
+        return n;
+#endif
+    }
+
+    std::vector<T> values_;
+    std::vector<word> bits_;
 };
 
+// Absent entries hold a sentinel value, for types that have one to spare
+// (e.g. a null pointer). Traits must provide `static T empty()` and
+// `static bool is_empty(T const&)`.
+template <typename T, typename Traits>
+struct sentinel_storage {
+    typedef T value_type;
+
+    std::size_t size() const { return values_.size(); }
+    void resize(std::size_t n) { values_.resize(n, Traits::empty()); }
+
+    bool present(std::size_t i) const { return !Traits::is_empty(values_[i]); }
+
+    T& get(std::size_t i) { return values_[i]; }
+    T const& get(std::size_t i) const { return values_[i]; }
+
+    void prefetch(std::size_t i) const {
+        shared_index_detail::prefetch(&values_[i]);
+    }
+
+    // The caller is expected to store a non-empty value.
+    T& insert(std::size_t i) { return values_[i]; }
+    void erase(std::size_t i) { values_[i] = Traits::empty(); }
+
+    template <typename F>
+    void for_each(F f) const {
+        for (std::size_t i = 0; i < values_.size(); ++i)
+            if (!Traits::is_empty(values_[i]))
+                f(i, values_[i]);
+    }
 
-template <typename T, typename SharedIndex>
+    std::size_t memory() const { return values_.capacity() * sizeof(T); }
+
+    void remap(std::vector<std::size_t> const& to, std::size_t span) {
+        std::size_t const n = std::min(values_.size(), to.size());
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t const j = to[i];
+            if (j == static_cast<std::size_t>(-1))
+                continue;
+            if (j != i)
+                std::swap(values_[j], values_[i]);
+        }
+        values_.resize(span, Traits::empty());
+        values_.shrink_to_fit();
+    }
+
+private:
+    std::vector<T> values_;
+};
+
+template <typename T>
+struct null_pointer_traits {
+    static T empty() { return 0; }
+    static bool is_empty(T const& p) { return p == 0; }
+};
+
+
+template <typename T, typename SharedIndex,
+          typename Storage = bitmap_storage<T> >
 struct IndexedContent {
     typedef typename SharedIndex::key_type key_type;
-    typedef typename T mapped_type;
+    typedef T mapped_type;
 
     explicit IndexedContent(SharedIndex const& index)
         : index_(index)
-    { }
+    {
+        attach();
+    }
 
+    IndexedContent(IndexedContent const& other)
+        : index_(other.index_), values_(other.values_)
+    {
+        attach();
+    }
+
+    ~IndexedContent() {
+        shared_index_detail::detach(index_, this);
+    }
+
+    // Returns the value associated to key, which must be in the index,
+    // default constructing it if it is not there yet.
     mapped_type& operator[](key_type const& key) {
-        BOOST_ASSERT(index_.span() < values_.size());
-        return values_[index_[key]];
+        typename SharedIndex::mapped_type const i = index_.find(key);
+        BOOST_ASSERT(i != SharedIndex::npos);
+        if (values_.size() < index_.span())
+            values_.resize(index_.span());
+        return values_.present(i) ? values_.get(i) : values_.insert(i);
+    }
+
+    // Returns the value associated to key, or null if there is none.
+    mapped_type* find(key_type const& key) {
+        typename SharedIndex::mapped_type const i = index_.find(key);
+        return present(i) ? &values_.get(i) : 0;
+    }
+
+    bool erase(key_type const& key) {
+        typename SharedIndex::mapped_type const i = index_.find(key);
+        if (!present(i))
+            return false;
+        values_.erase(i);
+        return true;
+    }
+
+    // Returns the value at an index obtained from the SharedIndex, or null
+    // if there is none. Unlike find(), this does not hash anything, so the
+    // index of a key can be looked up once and used with many contents.
+    mapped_type* at(typename SharedIndex::mapped_type i) {
+        return present(i) ? &values_.get(i) : 0;
+    }
+
+    mapped_type const* at(typename SharedIndex::mapped_type i) const {
+        return present(i) ? &values_.get(i) : 0;
+    }
+
+    // Hints that at(i) is about to be called.
+    void prefetch(typename SharedIndex::mapped_type i) const {
+        if (i < values_.size())
+            values_.prefetch(i);
     }
 
+    // Calls f(index, value) for every value present, in index order.
+    template <typename F>
+    void for_each(F f) const {
+        values_.for_each(f);
+    }
+
+    // Bytes allocated for the values and the presence information.
+    std::size_t memory() const { return values_.memory(); }
+
 private:
+    bool present(typename SharedIndex::mapped_type i) const {
+        return i < values_.size() && values_.present(i);
+    }
+
+    void attach() {
+        shared_index_detail::dependent const d = { this, &remap, &release };
+        shared_index_detail::attach(index_, d);
+    }
+
+    static void remap(void* self, std::vector<std::size_t> const& to,
+                      std::size_t span) {
+        static_cast<IndexedContent*>(self)->values_.remap(to, span);
+    }
+
+    static void release(void* self, std::size_t i) {
+        IndexedContent* const content = static_cast<IndexedContent*>(self);
+        if (content->present(i))
+            content->values_.erase(i);
+    }
+
     SharedIndex const& index_;
 
-    typedef std::vector<value_type> implementation_detail;
+    typedef Storage implementation_detail;
     implementation_detail values_;
+
+    friend struct shared_index_detail::snapshot_access;
+};
+
+
+// Writes the index of each key in [first, last) to out, or npos for the keys
+// that are not in the index. Returns the end of the output.
+template <typename SharedIndex, typename InputIterator, typename OutputIterator>
+OutputIterator resolve(SharedIndex const& index,
+                       InputIterator first, InputIterator last,
+                       OutputIterator out) {
+    for (; first != last; ++first, ++out)
+        *out = index.find(*first);
+    return out;
+}
+
+// Gathers the values at indices [0, n) from each of the contents in
+// [first, last) into out, one row of n values per content: out[c * n + k]
+// is the value of contents[c] at indices[k], or `missing` if it has none.
+// ContentIterator must dereference to a pointer to an IndexedContent.
+//
+// The rows are walked in order and the entries a few steps ahead are
+// prefetched, so that the loads from different contents overlap instead
+// of each waiting on its own cache miss.
+template <typename Index, typename ContentIterator, typename T>
+T* gather(Index const* indices, std::size_t n,
+          ContentIterator first, ContentIterator last,
+          T const& missing, T* out) {
+    static std::size_t const distance = 16;
+    if (n == 0)
+        return out;
+
+    // (ahead, k_ahead) runs `distance` entries in front of (first, k).
+    ContentIterator ahead = first;
+    std::size_t k_ahead = 0;
+    for (std::size_t d = 0; d < distance && ahead != last; ++d) {
+        (*ahead)->prefetch(indices[k_ahead]);
+        if (++k_ahead == n) {
+            k_ahead = 0;
+            ++ahead;
+        }
+    }
+
+    for (; first != last; ++first) {
+        for (std::size_t k = 0; k < n; ++k, ++out) {
+            if (ahead != last) {
+                (*ahead)->prefetch(indices[k_ahead]);
+                if (++k_ahead == n) {
+                    k_ahead = 0;
+                    ++ahead;
+                }
+            }
+            T const* value = (*first)->at(indices[k]);
+            *out = value ? *value : missing;
+        }
+    }
+    return out;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Concurrent version of SharedIndex.
+//
+// find() runs without locks in any number of threads; insert() and erase()
+// are serialized by a mutex. Readers probe an open addressing table that is
+// only ever replaced as a whole when it grows, and keys are stored in
+// segments that never move. Memory that readers might still be looking at
+// (old tables, indices of erased keys) is reclaimed with epochs: every
+// reading thread publishes the epoch it entered in a record of its own, and
+// something retired at epoch e is reused only once no reader is still in an
+// epoch <= e. In particular, an erased index is not handed out again while
+// a find() that could still return it is running.
+//
+// It otherwise has the interface of SharedIndex, dependents included: an
+// IndexedContent over it drops its value when the key is erased, and
+// follows compact(), which unlike the rest must have the index to itself.
+//////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace shared_index_detail {
+    std::size_t const max_readers = 256;
+
+    // Small integer identifying the current thread among the live reading
+    // threads, or max_readers if there are too many of them.
+    inline std::size_t reader_id() {
+        static std::atomic<bool> taken[max_readers];
+        struct registration {
+            std::size_t id;
+            registration() : id(max_readers) {
+                for (std::size_t i = 0; i < max_readers; ++i) {
+                    bool expected = false;
+                    if (taken[i].compare_exchange_strong(expected, true)) {
+                        id = i;
+                        break;
+                    }
+                }
+            }
+            ~registration() {
+                if (id != max_readers)
+                    taken[id].store(false);
+            }
+        };
+        static thread_local registration const self;
+        return self.id;
+    }
+} // end namespace shared_index_detail
+
+template <typename Key, typename Hash = boost::hash<Key>,
+                        typename Pred = std::equal_to<Key> >
+struct ConcurrentSharedIndex {
+    typedef Key key_type;
+    typedef std::size_t mapped_type;
+
+    static mapped_type const npos = static_cast<mapped_type>(-1);
+
+    explicit ConcurrentSharedIndex(Hash const& hash = Hash(),
+                                   Pred const& pred = Pred())
+        : hash_(hash), pred_(pred), table_(new table(16)), epoch_(1),
+          span_(0), size_(0), used_(0)
+    {
+        for (std::size_t s = 0; s < segments; ++s)
+            keys_[s].store(0, std::memory_order_relaxed);
+        for (std::size_t r = 0; r < shared_index_detail::max_readers; ++r)
+            readers_[r].epoch.store(0, std::memory_order_relaxed);
+    }
+
+    ~ConcurrentSharedIndex() {
+        delete table_.load();
+        for (std::size_t i = 0; i < retired_tables_.size(); ++i)
+            delete retired_tables_[i].first;
+        for (std::size_t i = 0; i < span_.load(); ++i)
+            key_at(i).~key_type();
+        for (std::size_t s = 0; s < segments; ++s)
+            ::operator delete(keys_[s].load());
+    }
+
+    // Returns the index of key, or npos if it is not there. Lock-free.
+    mapped_type find(key_type const& key) const {
+        std::size_t const r = shared_index_detail::reader_id();
+        if (r == shared_index_detail::max_readers) {
+            std::lock_guard<std::mutex> lock(writer_);
+            return lookup(key);
+        }
+
+        reader& self = readers_[r];
+        self.epoch.store(epoch_.load() + 1);
+        mapped_type const index = lookup(key);
+        self.epoch.store(0, std::memory_order_release);
+        return index;
+    }
+
+    // Returns the index of key, inserting it if it is not there yet.
+    mapped_type operator[](key_type const& key) {
+        return insert(key);
+    }
+
+    mapped_type insert(key_type const& key) {
+        std::lock_guard<std::mutex> lock(writer_);
+        std::size_t const h = hash_(key);
+        mapped_type const found = lookup(key);
+        if (found != npos)
+            return found;
+
+        table* t = table_.load(std::memory_order_relaxed);
+        if ((used_ + 1) * 2 > t->mask + 1)
+            t = grow();
+
+        mapped_type index;
+        if (freelist_.empty() &&
+            (!retired_indices_.empty() || !retired_tables_.empty()))
+            reclaim();
+        if (freelist_.empty()) {
+            index = span_.load(std::memory_order_relaxed);
+            new (&slot_for(index)) key_type(key);
+            live_.push_back(true);
+            span_.store(index + 1, std::memory_order_release);
+        }
+        else {
+            index = freelist_.back();
+            freelist_.pop_back();
+            key_at(index) = key;
+            live_[index] = true;
+        }
+
+        std::size_t i = h & t->mask;
+        for (; ; i = (i + 1) & t->mask) {
+            mapped_type const x = t->slots[i].index.load(
+                                                std::memory_order_relaxed);
+            if (x == vacant || x == tombstone)
+                break;
+        }
+        if (t->slots[i].index.load(std::memory_order_relaxed) == vacant)
+            ++used_;
+        t->slots[i].hash.store(h, std::memory_order_relaxed);
+        t->slots[i].index.store(index, std::memory_order_release);
+        ++size_;
+        return index;
+    }
+
+    // Removes key. Attached dependents drop what they hold at its index
+    // right away, and the index is reused once no reader can still return
+    // it.
+    bool erase(key_type const& key) {
+        std::lock_guard<std::mutex> lock(writer_);
+        table* t = table_.load(std::memory_order_relaxed);
+        std::size_t const h = hash_(key);
+        for (std::size_t i = h & t->mask; ; i = (i + 1) & t->mask) {
+            mapped_type const x = t->slots[i].index.load(
+                                                std::memory_order_relaxed);
+            if (x == vacant)
+                return false;
+            if (x != tombstone && t->slots[i].hash.load(
+                                    std::memory_order_relaxed) == h &&
+                pred_(key_at(x), key)) {
+                t->slots[i].index.store(tombstone);
+                dependents_.release(x);
+                live_[x] = false;
+                retired_indices_.push_back(std::make_pair(x, retire()));
+                --size_;
+                return true;
+            }
+        }
+    }
+
+    // The key at a live index, which stays in place until it is erased.
+    key_type const& key(mapped_type index) const {
+        BOOST_ASSERT(contains(index));
+        return key_at(index);
+    }
+
+    bool contains(mapped_type index) const {
+        std::lock_guard<std::mutex> lock(writer_);
+        return index < live_.size() && live_[index];
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(writer_);
+        return size_;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // Indices in use are always below span().
+    mapped_type span() const { return span_.load(std::memory_order_acquire); }
+
+    // Renumbers the keys into [0, size()) and has the attached dependents
+    // follow, like SharedIndex::compact(). Nothing else, find() included,
+    // may run on the index meanwhile, so everything retired is freed at
+    // once.
+    std::size_t compact(std::size_t threads = 1) {
+        std::lock_guard<std::mutex> lock(writer_);
+        std::size_t const old_span = span_.load(std::memory_order_relaxed);
+        if (size_ == old_span)
+            return 0;
+
+        std::vector<std::size_t> to(old_span, npos);
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < old_span; ++i) {
+            if (!live_[i])
+                continue;
+            to[i] = next;
+            if (i != next)
+                std::swap(key_at(next), key_at(i));
+            ++next;
+        }
+        BOOST_ASSERT(next == size_);
+        for (std::size_t i = size_; i < old_span; ++i)
+            key_at(i).~key_type();
+        for (std::size_t s = 0, base = 0; s < segments;
+                base += first_segment << s, ++s)
+            if (base >= size_) {
+                ::operator delete(keys_[s].load(std::memory_order_relaxed));
+                keys_[s].store(0, std::memory_order_relaxed);
+            }
+        span_.store(size_, std::memory_order_relaxed);
+        live_.assign(size_, true);
+        std::vector<mapped_type>().swap(freelist_);
+        retired_indices_.clear();
+        for (std::size_t i = 0; i < retired_tables_.size(); ++i)
+            delete retired_tables_[i].first;
+        retired_tables_.clear();
+
+        table* const old = table_.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i <= old->mask; ++i) {
+            mapped_type const x = old->slots[i].index.load(
+                                                std::memory_order_relaxed);
+            if (x != vacant && x != tombstone)
+                old->slots[i].index.store(to[x], std::memory_order_relaxed);
+        }
+        grow();
+        delete retired_tables_.back().first;
+        retired_tables_.pop_back();
+
+        dependents_.remap(to, size_, threads);
+        return old_span - size_;
+    }
+
+    // Registers d to be released by erase() and remapped by compact(); see
+    // SharedIndex::attach().
+    void attach(shared_index_detail::dependent const& d) const {
+        dependents_.attach(d);
+    }
+
+    void detach(void* object) const {
+        dependents_.detach(object);
+    }
+
+private:
+    static mapped_type const vacant = npos;
+    static mapped_type const tombstone = npos - 1;
+    static std::size_t const segments = 48;
+    static std::size_t const first_segment = 64;
+
+    struct slot {
+        std::atomic<std::size_t> hash;
+        std::atomic<mapped_type> index;
+    };
+
+    struct table {
+        explicit table(std::size_t n) : mask(n - 1), slots(new slot[n]) {
+            for (std::size_t i = 0; i < n; ++i) {
+                slots[i].hash.store(0, std::memory_order_relaxed);
+                slots[i].index.store(vacant, std::memory_order_relaxed);
+            }
+        }
+        ~table() { delete[] slots; }
+
+        std::size_t const mask;
+        slot* const slots;
+    };
+
+    // One per reading thread, on its own cache line.
+    struct alignas(64) reader {
+        std::atomic<unsigned long> epoch; // 0 when not reading
+        char padding[64 - sizeof(std::atomic<unsigned long>)];
+    };
+
+    // The loads are sequentially consistent so that they can't be ordered
+    // before the reader's epoch is published.
+    mapped_type lookup(key_type const& key) const {
+        table const* t = table_.load();
+        std::size_t const h = hash_(key);
+        for (std::size_t i = h & t->mask; ; i = (i + 1) & t->mask) {
+            mapped_type const x = t->slots[i].index.load();
+            if (x == vacant)
+                return npos;
+            if (x != tombstone && t->slots[i].hash.load(
+                                    std::memory_order_relaxed) == h &&
+                pred_(key_at(x), key))
+                return x;
+        }
+    }
+
+    // Segment s holds first_segment << s keys.
+    static std::size_t segment_of(std::size_t index, std::size_t& offset) {
+        std::size_t s = 0, base = 0;
+        while (index - base >= first_segment << s) {
+            base += first_segment << s;
+            ++s;
+        }
+        offset = index - base;
+        return s;
+    }
+
+    key_type const& key_at(std::size_t index) const {
+        std::size_t offset;
+        std::size_t const s = segment_of(index, offset);
+        return keys_[s].load(std::memory_order_acquire)[offset];
+    }
+
+    key_type& key_at(std::size_t index) {
+        return const_cast<key_type&>(
+            static_cast<ConcurrentSharedIndex const&>(*this).key_at(index));
+    }
+
+    // Raw storage for a new key, allocating its segment if needed.
+    key_type& slot_for(std::size_t index) {
+        std::size_t offset;
+        std::size_t const s = segment_of(index, offset);
+        key_type* segment = keys_[s].load(std::memory_order_relaxed);
+        if (!segment) {
+            segment = static_cast<key_type*>(
+                ::operator new((first_segment << s) * sizeof(key_type)));
+            keys_[s].store(segment, std::memory_order_release);
+        }
+        return segment[offset];
+    }
+
+    // Replaces the table by a larger one; the old one is retired.
+    table* grow() {
+        table* old = table_.load(std::memory_order_relaxed);
+        std::size_t capacity = 16;
+        while (capacity < (size_ + 1) * 4)
+            capacity *= 2;
+        table* t = new table(capacity);
+        for (std::size_t i = 0; i <= old->mask; ++i) {
+            mapped_type const x = old->slots[i].index.load(
+                                                std::memory_order_relaxed);
+            if (x == vacant || x == tombstone)
+                continue;
+            std::size_t const h = old->slots[i].hash.load(
+                                                std::memory_order_relaxed);
+            std::size_t j = h & t->mask;
+            while (t->slots[j].index.load(std::memory_order_relaxed) != vacant)
+                j = (j + 1) & t->mask;
+            t->slots[j].hash.store(h, std::memory_order_relaxed);
+            t->slots[j].index.store(x, std::memory_order_relaxed);
+        }
+        table_.store(t);
+        retired_tables_.push_back(std::make_pair(old, retire()));
+        used_ = size_;
+        return t;
+    }
+
+    // Starts a new epoch and returns the one things are retired in.
+    unsigned long retire() { return epoch_.fetch_add(1); }
+
+    // Frees what no reader can see anymore.
+    void reclaim() {
+        unsigned long oldest = epoch_.load();
+        for (std::size_t r = 0; r < shared_index_detail::max_readers; ++r) {
+            unsigned long const e = readers_[r].epoch.load();
+            if (e != 0 && e - 1 < oldest)
+                oldest = e - 1;
+        }
+
+        // Both lists are ordered by epoch.
+        while (!retired_tables_.empty() &&
+               retired_tables_.front().second < oldest) {
+            delete retired_tables_.front().first;
+            retired_tables_.pop_front();
+        }
+        while (!retired_indices_.empty() &&
+               retired_indices_.front().second < oldest) {
+            freelist_.push_back(retired_indices_.front().first);
+            retired_indices_.pop_front();
+        }
+    }
+
+    Hash hash_;
+    Pred pred_;
+    std::atomic<table*> table_;
+    std::atomic<key_type*> keys_[segments];
+    std::atomic<unsigned long> epoch_;
+    mutable reader readers_[shared_index_detail::max_readers];
+    std::atomic<std::size_t> span_;
+
+    // Only touched by writers.
+    mutable std::mutex writer_;
+    std::size_t size_;
+    std::size_t used_;
+    std::vector<bool> live_;
+    std::vector<mapped_type> freelist_;
+    std::deque<std::pair<mapped_type, unsigned long> > retired_indices_;
+    std::deque<std::pair<table*, unsigned long> > retired_tables_;
+    mutable shared_index_detail::dependent_list dependents_;
+};
+
+template <typename Key, typename Hash, typename Pred>
+typename ConcurrentSharedIndex<Key, Hash, Pred>::mapped_type const
+ConcurrentSharedIndex<Key, Hash, Pred>::npos;
+
+template <typename Key, typename Hash, typename Pred>
+typename ConcurrentSharedIndex<Key, Hash, Pred>::mapped_type const
+ConcurrentSharedIndex<Key, Hash, Pred>::vacant;
+
+template <typename Key, typename Hash, typename Pred>
+typename ConcurrentSharedIndex<Key, Hash, Pred>::mapped_type const
+ConcurrentSharedIndex<Key, Hash, Pred>::tombstone;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Snapshots.
+//
+// write_snapshot() dumps a SharedIndex and a set of IndexedContent to a file
+// whose layout is exactly what the readers use, so that opening it is just
+// a mmap(): SnapshotIndex and SnapshotContent probe and read the mapped
+// arrays in place and pages are faulted in as they are touched. Keys and
+// values must be trivially copyable, and Hash must give the same results
+// in the process reading the snapshot as in the one that wrote it.
+//
+// The mapping is read-only. To change the data, thaw() it back into a
+// SharedIndex and IndexedContent, which keep the same indices, and write
+// a new snapshot from those.
+//
+// Layout, in native byte order and with every array aligned on 64 bytes:
+//  header, content directory, probe slots, keys, live bits, then for each
+//  content its presence bits and values.
+//////////////////////////////////////////////////////////////////////////////
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace shared_index_detail {
+    std::size_t const snapshot_align = 64;
+    char const snapshot_magic[8] = {'S', 'H', 'I', 'D', 'X', 'S', 'N', '1'};
+
+    typedef unsigned long long snapshot_word;
+    std::size_t const snapshot_word_bits = sizeof(snapshot_word) * CHAR_BIT;
+
+    struct snapshot_header {
+        char magic[8];
+        std::size_t key_size;
+        std::size_t capacity; // probe slots, a power of two
+        std::size_t span;
+        std::size_t size;
+        std::size_t contents;
+        std::size_t slots;    // offsets from the start of the file
+        std::size_t keys;
+        std::size_t live;
+    };
+
+    struct snapshot_content {
+        std::size_t value_size;
+        std::size_t bits;
+        std::size_t values;
+    };
+
+    struct snapshot_slot {
+        std::size_t hash;
+        std::size_t index;
+    };
+
+    inline std::size_t snapshot_words(std::size_t span) {
+        return (span + snapshot_word_bits - 1) / snapshot_word_bits;
+    }
+
+    inline bool snapshot_bit(snapshot_word const* bits, std::size_t i) {
+        return (bits[i / snapshot_word_bits] >> (i % snapshot_word_bits)) & 1;
+    }
+
+    inline void snapshot_set(std::vector<snapshot_word>& bits, std::size_t i) {
+        bits[i / snapshot_word_bits] |=
+            snapshot_word(1) << (i % snapshot_word_bits);
+    }
+
+    // Writes n bytes at p and pads the file up to the next aligned offset.
+    inline bool snapshot_put(std::FILE* f, std::size_t& offset,
+                             void const* p, std::size_t n) {
+        static char const zeros[snapshot_align] = { };
+        std::size_t const pad = (snapshot_align - n % snapshot_align)
+                                % snapshot_align;
+        if (n != 0 && std::fwrite(p, 1, n, f) != n)
+            return false;
+        if (pad != 0 && std::fwrite(zeros, 1, pad, f) != pad)
+            return false;
+        offset += n + pad;
+        return true;
+    }
+
+    inline std::size_t snapshot_round(std::size_t n) {
+        return (n + snapshot_align - 1) / snapshot_align * snapshot_align;
+    }
+
+    // Reaches into SharedIndex and IndexedContent on behalf of the snapshot
+    // functions below.
+    struct snapshot_access {
+        template <typename Key, typename Hash, typename Pred,
+                  typename ContentIterator>
+        static bool write(char const* path,
+                          SharedIndex<Key, Hash, Pred> const& index,
+                          ContentIterator first, ContentIterator last);
+
+        template <typename Key, typename Hash, typename Pred>
+        static void thaw(snapshot_header const& header, char const* base,
+                         SharedIndex<Key, Hash, Pred>& index);
+
+        template <typename Content, typename T>
+        static void thaw(snapshot_word const* bits, T const* values,
+                         std::size_t span, Content& content);
+    };
+} // end namespace shared_index_detail
+
+// Writes index and the contents in [first, last) to path, replacing it.
+// ContentIterator must dereference to a pointer to an IndexedContent of
+// index. Returns false if the file could not be written.
+template <typename Key, typename Hash, typename Pred, typename ContentIterator>
+bool write_snapshot(char const* path,
+                    SharedIndex<Key, Hash, Pred> const& index,
+                    ContentIterator first, ContentIterator last) {
+    return shared_index_detail::snapshot_access::write(path, index,
+                                                       first, last);
+}
+
+// A snapshot file mapped in memory.
+class MappedSnapshot {
+public:
+    MappedSnapshot() : data_(0), size_(0) { }
+    ~MappedSnapshot() { close(); }
+
+    // Maps the snapshot at path, returning false if it cannot be opened or
+    // is not a snapshot.
+    bool open(char const* path) {
+        close();
+        int const fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        void* data = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            data = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        data_ = static_cast<char const*>(data);
+        size_ = st.st_size;
+        if (!valid()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (data_)
+            ::munmap(const_cast<char*>(data_), size_);
+        data_ = 0;
+        size_ = 0;
+    }
+
+    bool is_open() const { return data_ != 0; }
+
+    // Number of contents stored along with the index.
+    std::size_t contents() const { return header().contents; }
+
+    // Size of the file, in bytes.
+    std::size_t size() const { return size_; }
+
+    shared_index_detail::snapshot_header const& header() const {
+        BOOST_ASSERT(is_open());
+        return *reinterpret_cast<shared_index_detail::snapshot_header const*>(
+            data_);
+    }
+
+    shared_index_detail::snapshot_content const& content(std::size_t c) const {
+        BOOST_ASSERT(c < contents());
+        return reinterpret_cast<shared_index_detail::snapshot_content const*>(
+            data_ + shared_index_detail::snapshot_round(
+                sizeof(shared_index_detail::snapshot_header)))[c];
+    }
+
+    template <typename T>
+    T const* at(std::size_t offset) const {
+        return reinterpret_cast<T const*>(data_ + offset);
+    }
+
+private:
+    MappedSnapshot(MappedSnapshot const&);
+    MappedSnapshot& operator=(MappedSnapshot const&);
+
+    // Checks that the header and directory describe arrays lying within
+    // the file.
+    bool valid() const {
+        using namespace shared_index_detail;
+        if (size_ < sizeof(snapshot_header))
+            return false;
+        snapshot_header const& h = header();
+        if (std::memcmp(h.magic, snapshot_magic, sizeof snapshot_magic) != 0)
+            return false;
+        std::size_t const directory = snapshot_round(sizeof h);
+        if (h.contents > (size_ - directory) / sizeof(snapshot_content))
+            return false;
+        if (!fits(h.slots, h.capacity, sizeof(snapshot_slot)) ||
+            !fits(h.keys, h.span, h.key_size) ||
+            !fits(h.live, snapshot_words(h.span), sizeof(snapshot_word)))
+            return false;
+        for (std::size_t c = 0; c < h.contents; ++c) {
+            snapshot_content const& d = content(c);
+            if (!fits(d.bits, snapshot_words(h.span), sizeof(snapshot_word)) ||
+                !fits(d.values, h.span, d.value_size))
+                return false;
+        }
+        return h.capacity != 0 && (h.capacity & (h.capacity - 1)) == 0;
+    }
+
+    bool fits(std::size_t offset, std::size_t n, std::size_t size) const {
+        return offset % shared_index_detail::snapshot_align == 0 &&
+               offset <= size_ && (size == 0 || n <= (size_ - offset) / size);
+    }
+
+    char const* data_;
+    std::size_t size_;
+};
+
+// Read-only SharedIndex over a MappedSnapshot, which must outlive it.
+template <typename Key, typename Hash = boost::hash<Key>,
+                        typename Pred = std::equal_to<Key> >
+struct SnapshotIndex {
+    typedef Key key_type;
+    typedef std::size_t mapped_type;
+
+    static mapped_type const npos = static_cast<mapped_type>(-1);
+
+    explicit SnapshotIndex(MappedSnapshot const& snapshot,
+                           Hash const& hash = Hash(), Pred const& pred = Pred())
+        : snapshot_(snapshot), hash_(hash), pred_(pred),
+          header_(snapshot.header()),
+          slots_(snapshot.at<snapshot_slot>(header_.slots)),
+          keys_(snapshot.at<key_type>(header_.keys)),
+          live_(snapshot.at<snapshot_word>(header_.live))
+    {
+        BOOST_ASSERT(header_.key_size == sizeof(key_type));
+    }
+
+    // Returns the index of key, or npos if it is not there.
+    mapped_type find(key_type const& key) const {
+        std::size_t const h = hash_(key);
+        std::size_t const mask = header_.capacity - 1;
+        for (std::size_t i = h & mask; ; i = (i + 1) & mask) {
+            snapshot_slot const& s = slots_[i];
+            if (s.index == vacant)
+                return npos;
+            if (s.index != tombstone && s.hash == h &&
+                pred_(keys_[s.index], key))
+                return s.index;
+        }
+    }
+
+    key_type const& key(mapped_type index) const {
+        BOOST_ASSERT(contains(index));
+        return keys_[index];
+    }
+
+    bool contains(mapped_type index) const {
+        return index < header_.span &&
+               shared_index_detail::snapshot_bit(live_, index);
+    }
+
+    std::size_t size() const { return header_.size; }
+    bool empty() const { return header_.size == 0; }
+    mapped_type span() const { return header_.span; }
+
+    MappedSnapshot const& snapshot() const { return snapshot_; }
+
+private:
+    static mapped_type const vacant = npos;
+    static mapped_type const tombstone = npos - 1;
+
+    typedef shared_index_detail::snapshot_slot snapshot_slot;
+    typedef shared_index_detail::snapshot_word snapshot_word;
+
+    MappedSnapshot const& snapshot_;
+    Hash hash_;
+    Pred pred_;
+    shared_index_detail::snapshot_header const& header_;
+    snapshot_slot const* slots_;
+    key_type const* keys_;
+    snapshot_word const* live_;
 };
+
+template <typename Key, typename Hash, typename Pred>
+typename SnapshotIndex<Key, Hash, Pred>::mapped_type const
+SnapshotIndex<Key, Hash, Pred>::npos;
+
+template <typename Key, typename Hash, typename Pred>
+typename SnapshotIndex<Key, Hash, Pred>::mapped_type const
+SnapshotIndex<Key, Hash, Pred>::vacant;
+
+template <typename Key, typename Hash, typename Pred>
+typename SnapshotIndex<Key, Hash, Pred>::mapped_type const
+SnapshotIndex<Key, Hash, Pred>::tombstone;
+
+// Read-only IndexedContent for the c-th content of a snapshot. It offers
+// the same lookups, so gather() works on it as well.
+template <typename T, typename SnapshotIndex>
+struct SnapshotContent {
+    typedef typename SnapshotIndex::key_type key_type;
+    typedef T mapped_type;
+
+    SnapshotContent(SnapshotIndex const& index, std::size_t c)
+        : index_(index),
+          bits_(index.snapshot().template at<snapshot_word>(
+              index.snapshot().content(c).bits)),
+          values_(index.snapshot().template at<T>(
+              index.snapshot().content(c).values))
+    {
+        BOOST_ASSERT(index.snapshot().content(c).value_size == sizeof(T));
+    }
+
+    // Returns the value associated to key, or null if there is none.
+    mapped_type const* find(key_type const& key) const {
+        return at(index_.find(key));
+    }
+
+    mapped_type const* at(typename SnapshotIndex::mapped_type i) const {
+        return present(i) ? &values_[i] : 0;
+    }
+
+    void prefetch(typename SnapshotIndex::mapped_type i) const {
+        if (i < index_.span()) {
+            shared_index_detail::prefetch(
+                &bits_[i / shared_index_detail::snapshot_word_bits]);
+            shared_index_detail::prefetch(&values_[i]);
+        }
+    }
+
+    // Calls f(index, value) for every value present, in index order.
+    template <typename F>
+    void for_each(F f) const {
+        for (std::size_t i = 0; i < index_.span(); ++i)
+            if (shared_index_detail::snapshot_bit(bits_, i))
+                f(i, values_[i]);
+    }
+
+    // Copies the content into c, whose index must have been thawed from
+    // the same snapshot.
+    template <typename Storage, typename SharedIndex>
+    void thaw(IndexedContent<T, SharedIndex, Storage>& c) const {
+        shared_index_detail::snapshot_access::thaw(bits_, values_,
+                                                   index_.span(), c);
+    }
+
+private:
+    bool present(typename SnapshotIndex::mapped_type i) const {
+        return i < index_.span() && shared_index_detail::snapshot_bit(bits_, i);
+    }
+
+    typedef shared_index_detail::snapshot_word snapshot_word;
+
+    SnapshotIndex const& index_;
+    snapshot_word const* bits_;
+    T const* values_;
+};
+
+// Rebuilds index from a snapshot, with every key at the index it had when
+// the snapshot was written. Contents are thawed with SnapshotContent::thaw.
+template <typename Key, typename Hash, typename Pred>
+void thaw(SnapshotIndex<Key, Hash, Pred> const& snapshot,
+          SharedIndex<Key, Hash, Pred>& index) {
+    MappedSnapshot const& s = snapshot.snapshot();
+    shared_index_detail::snapshot_access::thaw(
+        s.header(), s.at<char>(0), index);
+}
+
+namespace shared_index_detail {
+    template <typename Key, typename Hash, typename Pred,
+              typename ContentIterator>
+    bool snapshot_access::write(char const* path,
+                                SharedIndex<Key, Hash, Pred> const& index,
+                                ContentIterator first, ContentIterator last) {
+        static_assert(std::is_trivially_copyable<Key>::value,
+                      "snapshot keys must be trivially copyable");
+        typedef typename std::iterator_traits<ContentIterator>::value_type
+            pointer;
+        typedef typename std::remove_pointer<pointer>::type::mapped_type T;
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "snapshot values must be trivially copyable");
+
+        std::size_t const span = index.span();
+        std::size_t const words = snapshot_words(span);
+
+        snapshot_header h;
+        std::memset(&h, 0, sizeof h);
+        std::memcpy(h.magic, snapshot_magic, sizeof h.magic);
+        h.key_size = sizeof(Key);
+        // An empty index has no probe table yet, but readers need one.
+        h.capacity = std::max<std::size_t>(index.slots_.size(), 1);
+        h.span = span;
+        h.size = index.size();
+        h.contents = std::distance(first, last);
+
+        // Lay out the file before writing anything.
+        std::size_t offset =
+            snapshot_round(sizeof h) +
+            snapshot_round(h.contents * sizeof(snapshot_content));
+        h.slots = offset;
+        offset += snapshot_round(h.capacity * sizeof(snapshot_slot));
+        h.keys = offset;
+        offset += snapshot_round(span * sizeof(Key));
+        h.live = offset;
+        offset += snapshot_round(words * sizeof(snapshot_word));
+        std::vector<snapshot_content> directory(h.contents);
+        for (std::size_t c = 0; c < h.contents; ++c) {
+            directory[c].value_size = sizeof(T);
+            directory[c].bits = offset;
+            offset += snapshot_round(words * sizeof(snapshot_word));
+            directory[c].values = offset;
+            offset += snapshot_round(span * sizeof(T));
+        }
+
+        typedef SharedIndex<Key, Hash, Pred> Index;
+        snapshot_slot const vacant = { 0, Index::vacant };
+        std::vector<snapshot_slot> slots(h.capacity, vacant);
+        for (std::size_t i = 0; i < index.slots_.size(); ++i) {
+            slots[i].hash = index.slots_[i].hash;
+            slots[i].index = index.slots_[i].index;
+        }
+
+        std::vector<snapshot_word> live(words, 0);
+        for (std::size_t i = 0; i < span; ++i)
+            if (index.live_[i])
+                snapshot_set(live, i);
+
+        std::FILE* f = std::fopen(path, "wb");
+        if (!f)
+            return false;
+        std::size_t at = 0;
+        bool ok = snapshot_put(f, at, &h, sizeof h) &&
+                  snapshot_put(f, at, directory.empty() ? 0 : &directory[0],
+                               directory.size() * sizeof(snapshot_content)) &&
+                  snapshot_put(f, at, &slots[0],
+                               slots.size() * sizeof(snapshot_slot)) &&
+                  snapshot_put(f, at, span ? &index.keys_[0] : 0,
+                               span * sizeof(Key)) &&
+                  snapshot_put(f, at, live.empty() ? 0 : &live[0],
+                               words * sizeof(snapshot_word));
+
+        std::vector<snapshot_word> bits;
+        std::vector<T> values;
+        for (; ok && first != last; ++first) {
+            bits.assign(words, 0);
+            values.assign(span, T());
+            (*first)->for_each([&](std::size_t i, T const& v) {
+                if (i < span) {
+                    snapshot_set(bits, i);
+                    values[i] = v;
+                }
+            });
+            ok = snapshot_put(f, at, bits.empty() ? 0 : &bits[0],
+                              words * sizeof(snapshot_word)) &&
+                 snapshot_put(f, at, values.empty() ? 0 : &values[0],
+                              span * sizeof(T));
+        }
+        BOOST_ASSERT(!ok || at == offset);
+        return std::fclose(f) == 0 && ok;
+    }
+
+    template <typename Key, typename Hash, typename Pred>
+    void snapshot_access::thaw(snapshot_header const& h, char const* base,
+                               SharedIndex<Key, Hash, Pred>& index) {
+        typedef SharedIndex<Key, Hash, Pred> Index;
+        snapshot_slot const* slots =
+            reinterpret_cast<snapshot_slot const*>(base + h.slots);
+        Key const* keys = reinterpret_cast<Key const*>(base + h.keys);
+        snapshot_word const* live =
+            reinterpret_cast<snapshot_word const*>(base + h.live);
+
+        index.keys_.assign(keys, keys + h.span);
+        index.live_.assign(h.span, false);
+        index.freelist_.clear();
+        for (std::size_t i = h.span; i-- > 0; ) {
+            if (snapshot_bit(live, i))
+                index.live_[i] = true;
+            else
+                index.freelist_.push_back(i);
+        }
+
+        index.slots_.resize(h.capacity);
+        index.used_ = 0;
+        for (std::size_t i = 0; i < h.capacity; ++i) {
+            index.slots_[i].hash = slots[i].hash;
+            index.slots_[i].index = slots[i].index;
+            if (slots[i].index != Index::vacant)
+                ++index.used_;
+        }
+        index.size_ = h.size;
+    }
+
+    template <typename Content, typename T>
+    void snapshot_access::thaw(snapshot_word const* bits, T const* values,
+                               std::size_t span, Content& content) {
+        content.values_ = typename Content::implementation_detail();
+        content.values_.resize(span);
+        for (std::size_t i = 0; i < span; ++i)
+            if (snapshot_bit(bits, i))
+                content.values_.insert(i) = values[i];
+    }
+} // end namespace shared_index_detail
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Tests
+//////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <map>
+
+template <typename Index>
+void reused_index_starts_empty() {
+    Index index;
+    IndexedContent<double, Index> content(index);
+    index.insert(3);
+    content[3] = 3.5;
+    index.erase(3);
+    index.insert(7);
+    BOOST_ASSERT(index.find(7) == 0);
+    BOOST_ASSERT(content.find(7) == 0);
+    BOOST_ASSERT(content.at(0) == 0);
+    content[7] = 7.5;
+    BOOST_ASSERT(*content.find(7) == 7.5);
+}
+
+template <typename Index>
+void compact_moves_contents() {
+    Index index;
+    IndexedContent<int, Index> content(index);
+    for (int k = 0; k < 1000; ++k)
+        content[index[k]] = -k;
+    for (int k = 0; k < 1000; k += 3)
+        index.erase(k);
+
+    std::size_t const reclaimed = index.compact(2);
+    BOOST_ASSERT(reclaimed == 334);
+    BOOST_ASSERT(index.span() == index.size());
+    for (int k = 0; k < 1000; ++k) {
+        std::size_t const i = index.find(k);
+        BOOST_ASSERT((k % 3 == 0) == (i == Index::npos));
+        BOOST_ASSERT(k % 3 == 0 || (index.contains(i) && index.key(i) == k));
+        BOOST_ASSERT(k % 3 == 0 ? !content.find(k) : *content.find(k) == -k);
+        (void)i;
+    }
+    BOOST_ASSERT(!index.empty());
+    (void)reclaimed;
+}
+
+// Read-heavy benchmark of ConcurrentSharedIndex: every thread does one
+// insert() or erase() per 99 find()s. The total number of operations is
+// fixed, so on a multi-core machine the throughput should grow with the
+// threads up to the number of cores, the writes being the only contention.
+void benchmark_concurrent_index() {
+    typedef ConcurrentSharedIndex<int> Index;
+    int const keys = 1 << 16;
+    std::size_t const ops = std::size_t(1) << 24;
+    unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, cores)) {
+        Index index;
+        for (int k = 0; k < keys; ++k)
+            index.insert(k);
+
+        std::atomic<std::size_t> hits(0);
+        std::vector<std::thread> workers;
+        auto const start = std::chrono::steady_clock::now();
+        for (unsigned t = 0; t < threads; ++t)
+            workers.push_back(std::thread([&index, &hits, t, threads] {
+                unsigned x = t + 1;
+                std::size_t found = 0;
+                for (std::size_t i = 0; i < ops / threads; ++i) {
+                    x = x * 1103515245 + 12345;
+                    int const k = (x >> 8) % keys;
+                    // Writes go to keys outside the ones being read.
+                    if (i % 100 == 99 && (x & 1))
+                        index.insert(keys + k);
+                    else if (i % 100 == 99)
+                        index.erase(keys + k);
+                    else
+                        found += index.find(k) != Index::npos;
+                }
+                hits += found;
+            }));
+        for (unsigned t = 0; t < threads; ++t)
+            workers[t].join();
+        std::chrono::duration<double> const elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        std::printf("%3u threads: %7.1f Mops/s (%zu hits)\n", threads,
+                    ops / elapsed.count() / 1e6, hits.load());
+        if (threads == cores)
+            break;
+    }
+}
+
+// The lookup the shared index is meant for: resolve() a batch of keys once,
+// then gather() their values from every content. It is compared with a
+// find() per key and content, which hashes the key again for each content,
+// and with what the shared index replaces, a std::map per content. Every
+// content has a value for one key in four.
+void benchmark_gather() {
+    typedef SharedIndex<int> Index;
+    typedef IndexedContent<int, Index> Content;
+    int const universe = 1 << 14;
+    std::size_t const max_contents = 1000;
+    std::size_t const values = std::size_t(1) << 23;
+
+    Index index;
+    for (int k = 0; k < universe; ++k)
+        index.insert(k);
+    std::vector<Content> contents(max_contents, Content(index));
+    std::vector<std::map<int, int> > maps(max_contents);
+    std::vector<Content const*> pointers;
+    unsigned x = 1;
+    for (std::size_t c = 0; c < max_contents; ++c) {
+        for (int k = 0; k < universe; ++k) {
+            x = x * 1103515245 + 12345;
+            if ((x >> 16) % 4 == 0)
+                contents[c][k] = maps[c][k] = k;
+        }
+        pointers.push_back(&contents[c]);
+    }
+
+    std::size_t const key_counts[] = { 1, 100, 10000 };
+    std::size_t const content_counts[] = { 1, 10, 1000 };
+    for (std::size_t nk : key_counts) {
+        std::vector<int> keys(nk);
+        for (std::size_t k = 0; k < nk; ++k) {
+            x = x * 1103515245 + 12345;
+            keys[k] = (x >> 8) % universe;
+        }
+        for (std::size_t nc : content_counts) {
+            std::size_t const rounds = std::max<std::size_t>(1,
+                                                    values / (nk * nc));
+            std::vector<std::size_t> indices(nk);
+            std::vector<int> gathered(nk * nc), found(nk * nc),
+                             mapped(nk * nc);
+            auto const ns_per_value = [=](
+                    std::chrono::steady_clock::time_point const& start) {
+                std::chrono::duration<double, std::nano> const elapsed =
+                    std::chrono::steady_clock::now() - start;
+                return elapsed.count() / (rounds * nk * nc);
+            };
+
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t r = 0; r < rounds; ++r) {
+                resolve(index, keys.begin(), keys.end(), indices.begin());
+                gather(indices.data(), nk, pointers.begin(),
+                       pointers.begin() + nc, -1, gathered.data());
+            }
+            double const gather_ns = ns_per_value(start);
+
+            start = std::chrono::steady_clock::now();
+            for (std::size_t r = 0; r < rounds; ++r)
+                for (std::size_t c = 0; c < nc; ++c)
+                    for (std::size_t k = 0; k < nk; ++k) {
+                        int const* value = contents[c].find(keys[k]);
+                        found[c * nk + k] = value ? *value : -1;
+                    }
+            double const find_ns = ns_per_value(start);
+
+            start = std::chrono::steady_clock::now();
+            for (std::size_t r = 0; r < rounds; ++r)
+                for (std::size_t c = 0; c < nc; ++c)
+                    for (std::size_t k = 0; k < nk; ++k) {
+                        std::map<int, int>::const_iterator const it =
+                            maps[c].find(keys[k]);
+                        mapped[c * nk + k] =
+                            it != maps[c].end() ? it->second : -1;
+                    }
+            double const map_ns = ns_per_value(start);
+
+            BOOST_ASSERT(gathered == found && found == mapped);
+            std::printf("%5zu keys x %4zu contents: gather %5.1f, "
+                        "find %5.1f, std::map %6.1f ns/value\n",
+                        nk, nc, gather_ns, find_ns, map_ns);
+        }
+    }
+}
+
+// Compaction of an index of 1M keys of which 3 in 4 were erased, with 16
+// contents of doubles depending on it, remapped by 1 up to as many threads
+// as there are cores.
+void benchmark_compaction() {
+    typedef SharedIndex<int> Index;
+    typedef IndexedContent<double, Index> Content;
+    int const keys = 1 << 20;
+    std::size_t const dependents = 16;
+    unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, cores)) {
+        Index index;
+        for (int k = 0; k < keys; ++k)
+            index.insert(k);
+        std::vector<Content> contents(dependents, Content(index));
+        for (std::size_t c = 0; c < dependents; ++c)
+            for (int k = 0; k < keys; ++k)
+                contents[c][k] = k;
+        for (int k = 0; k < keys; ++k)
+            if (k % 4 != 0)
+                index.erase(k);
+
+        std::size_t before = 0, after = 0;
+        for (std::size_t c = 0; c < dependents; ++c)
+            before += contents[c].memory();
+        auto const start = std::chrono::steady_clock::now();
+        std::size_t const reclaimed = index.compact(threads);
+        std::chrono::duration<double, std::milli> const elapsed =
+            std::chrono::steady_clock::now() - start;
+        for (std::size_t c = 0; c < dependents; ++c)
+            after += contents[c].memory();
+
+        for (int k = 0; k < keys; k += 4 * 1021) {
+            double const* value = contents[k % dependents].find(k);
+            BOOST_ASSERT(value && *value == k);
+            (void)value;
+        }
+        std::printf("%3u threads: compact %6.1f ms, %zu indices and "
+                    "%.1f of %.1f MB reclaimed\n", threads, elapsed.count(),
+                    reclaimed, (before - after) / 1048576.0,
+                    before / 1048576.0);
+        if (threads == cores)
+            break;
+    }
+}
+
+// Startup from a snapshot of an index of 1M keys and 16 contents of
+// doubles: mapping it and looking up a first key, against rebuilding the
+// index and its contents, and against thawing the snapshot back into them.
+// The snapshot was just written, so the file is in the page cache.
+void benchmark_snapshot_load() {
+    typedef SharedIndex<int> Index;
+    typedef IndexedContent<double, Index> Content;
+    typedef SnapshotIndex<int> Snapshot;
+    int const keys = 1 << 20;
+    std::size_t const dependents = 16;
+    char const* const path = "shared_index_benchmark.snapshot";
+    auto const ms_since = [](std::chrono::steady_clock::time_point const& t) {
+        std::chrono::duration<double, std::milli> const elapsed =
+            std::chrono::steady_clock::now() - t;
+        return elapsed.count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    Index index;
+    std::vector<Content> contents(dependents, Content(index));
+    for (int k = 0; k < keys; ++k) {
+        index.insert(k);
+        for (std::size_t c = 0; c < dependents; ++c)
+            contents[c][k] = k + c;
+    }
+    double const rebuild_ms = ms_since(start);
+
+    std::vector<Content const*> pointers;
+    for (std::size_t c = 0; c < dependents; ++c)
+        pointers.push_back(&contents[c]);
+    start = std::chrono::steady_clock::now();
+    bool const written = write_snapshot(path, index, pointers.begin(),
+                                        pointers.end());
+    double const write_ms = ms_since(start);
+    BOOST_ASSERT(written);
+    (void)written;
+
+    start = std::chrono::steady_clock::now();
+    MappedSnapshot snapshot;
+    bool const opened = snapshot.open(path);
+    BOOST_ASSERT(opened);
+    (void)opened;
+    Snapshot const mapped(snapshot);
+    SnapshotContent<double, Snapshot> const last(mapped, dependents - 1);
+    double const* value = last.find(keys / 2);
+    double const open_ms = ms_since(start);
+    BOOST_ASSERT(value && *value == keys / 2 + dependents - 1);
+    (void)value;
+
+    start = std::chrono::steady_clock::now();
+    double sum = 0;
+    for (int k = 0; k < keys; ++k)
+        sum += *last.find(k);
+    double const find_ms = ms_since(start);
+
+    start = std::chrono::steady_clock::now();
+    Index thawed;
+    thaw(mapped, thawed);
+    std::vector<Content> thawed_contents(dependents, Content(thawed));
+    for (std::size_t c = 0; c < dependents; ++c)
+        SnapshotContent<double, Snapshot>(mapped, c).thaw(thawed_contents[c]);
+    double const thaw_ms = ms_since(start);
+    BOOST_ASSERT(*thawed_contents[dependents - 1].find(keys / 2) ==
+                 keys / 2 + dependents - 1);
+
+    std::printf("snapshot of %d keys x %zu contents, %.1f MB: rebuild "
+                "%.1f ms, write %.1f ms, open and first find %.3f ms, "
+                "find of every key %.1f ms (sum %g), thaw %.1f ms\n",
+                keys, dependents, snapshot.size() / 1048576.0, rebuild_ms,
+                write_ms, open_ms, find_ms, sum, thaw_ms);
+    snapshot.close();
+    std::remove(path);
+}
+
+int main() {
+    reused_index_starts_empty<SharedIndex<int> >();
+    reused_index_starts_empty<ConcurrentSharedIndex<int> >();
+    compact_moves_contents<SharedIndex<int> >();
+    compact_moves_contents<ConcurrentSharedIndex<int> >();
+    benchmark_concurrent_index();
+    benchmark_gather();
+    benchmark_compaction();
+    benchmark_snapshot_load();
+}
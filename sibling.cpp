@@ -4,8 +4,14 @@
 
 #include <boost/assert.hpp>
 #include <boost/move/move.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
 #include <boost/utility/swap.hpp>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
 
 
 namespace sandbox {
@@ -122,15 +128,579 @@ struct siblings {
 private:
     BOOST_MOVABLE_BUT_NOT_COPYABLE(siblings)
 };
+
+template <typename T> struct channel_sender;
+template <typename T> struct channel_receiver;
+
+namespace detail {
+/*!
+ * One end of a two-nodes linked list whose ends may be used and moved
+ * concurrently from two threads.
+ *
+ * The link to the other end is stored along with a lock bit. Changing the
+ * link between two ends requires holding the locks of both ends, so an end
+ * can't go away while the other one holds its lock. To avoid deadlocks,
+ * the end at the lower address waits for the other one, while the end at
+ * the higher address backs off when it can't get the other lock.
+ */
+struct channel_end {
+protected:
+    channel_end() : link_(0) { }
+    explicit channel_end(channel_end* other)
+        : link_(reinterpret_cast<std::uintptr_t>(other))
+    { }
+
+    // Locks *this and the other end if there is one, and returns it.
+    channel_end* lock_pair() {
+        for (;;) {
+            lock();
+            channel_end* other = locked_other();
+            if (other == NULL)
+                return NULL;
+            if (address(this) < address(other)) {
+                other->lock();
+                return other;
+            }
+            if (other->try_lock())
+                return other;
+            unlock(other);
+            std::this_thread::yield();
+        }
+    }
+
+    // Must be called with the lock held; releases it and links *this to
+    // other at the same time.
+    void unlock(channel_end* other) {
+        link_.store(address(other), std::memory_order_release);
+    }
+
+    // Links the (unlinked) *this to other, whose lock must be held by the
+    // caller, and releases that lock.
+    void adopt(channel_end* other) {
+        link_.store(address(other), std::memory_order_relaxed);
+        other->unlock(this);
+    }
+
+    // Takes over the link of the (unlinked) end src, which is left alone.
+    void take(channel_end& src) {
+        channel_end* other = src.lock_pair();
+        if (other != NULL)
+            adopt(other);
+        src.unlock(NULL);
+    }
+
+    // Unlinks *this and the other end, returning the latter, which is left
+    // locked and must be released by the caller.
+    channel_end* unlink() {
+        channel_end* other = lock_pair();
+        unlock(NULL);
+        return other;
+    }
+
+    static void release(channel_end* end) {
+        end->unlock(NULL);
+    }
+
+    // Releases the locks of *this and other, taken by lock_pair(), leaving
+    // the two ends linked to each other as they were.
+    void relink(channel_end* other) {
+        other->unlock(this);
+        unlock(other);
+    }
+
+    bool is_linked() const {
+        return (link_.load(std::memory_order_acquire) & ~locked) != 0;
+    }
+
+private:
+    static std::uintptr_t const locked = 1;
+
+    static std::uintptr_t address(channel_end const* end) {
+        return reinterpret_cast<std::uintptr_t>(end);
+    }
+
+    channel_end* locked_other() const {
+        return reinterpret_cast<channel_end*>(
+                    link_.load(std::memory_order_relaxed) & ~locked);
+    }
+
+    void lock() {
+        while (!try_lock())
+            std::this_thread::yield();
+    }
+
+    bool try_lock() {
+        std::uintptr_t link = link_.load(std::memory_order_relaxed) & ~locked;
+        return link_.compare_exchange_strong(link, link | locked,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+    std::atomic<std::uintptr_t> link_;
+};
+} // end namespace detail
+
+/*!
+ * Sending end of a one-shot channel; see `channel`.
+ */
+template <typename T>
+struct channel_sender : private detail::channel_end {
+    channel_sender(BOOST_RV_REF(channel_sender) other) {
+        take(other);
+    }
+
+    channel_sender& operator=(BOOST_RV_REF(channel_sender) other) {
+        if (this != &other) {
+            abandon();
+            take(other);
+        }
+        return *this;
+    }
+
+    ~channel_sender() { abandon(); }
+
+    // Stores value in the receiving end. Returns false if there was no
+    // receiving end anymore. In any case, the sender is left unlinked.
+    bool set_value(T const& value) {
+        return deliver<T const&>(value);
+    }
+
+    bool set_value(BOOST_RV_REF(T) value) {
+        return deliver<BOOST_RV_REF(T)>(boost::move(value));
+    }
+
+    // Whether the receiving end is still there and waiting for a value.
+    bool has_receiver() const { return is_linked(); }
+
+private:
+    BOOST_MOVABLE_BUT_NOT_COPYABLE(channel_sender)
+
+    template <typename U>
+    friend struct channel;
+    friend struct channel_receiver<T>;
+
+    explicit channel_sender(channel_end* receiver) : channel_end(receiver) { }
+
+    // The value is constructed while both ends are locked. If that throws,
+    // the ends are unlocked and stay linked, as if nothing had been sent.
+    template <typename Value>
+    bool deliver(Value value) {
+        channel_end* other = lock_pair();
+        if (other == NULL) {
+            unlock(NULL);
+            return false;
+        }
+        struct relink_on_throw {
+            channel_sender* self;
+            channel_end* other;
+            ~relink_on_throw() { if (other != NULL) self->relink(other); }
+        } guard = { this, other };
+
+        channel_receiver<T>* receiver =
+            static_cast<channel_receiver<T>*>(other);
+        ::new (receiver->address()) T(static_cast<Value>(value));
+        guard.other = NULL;
+        receiver->state_.store(channel_receiver<T>::received,
+                               std::memory_order_release);
+        unlock(NULL);
+        release(receiver);
+        return true;
+    }
+
+    // Lets the receiving end know that it won't ever get a value.
+    void abandon() {
+        channel_receiver<T>* receiver =
+            static_cast<channel_receiver<T>*>(unlink());
+        if (receiver != NULL) {
+            receiver->state_.store(channel_receiver<T>::broken,
+                                   std::memory_order_release);
+            release(receiver);
+        }
+    }
+};
+
+/*!
+ * Receiving end of a one-shot channel; see `channel`. The value is stored
+ * inline, in the receiving end itself.
+ */
+template <typename T>
+struct channel_receiver : private detail::channel_end {
+    channel_receiver(BOOST_RV_REF(channel_receiver) other)
+        : state_(waiting)
+    {
+        take_from(other);
+    }
+
+    channel_receiver& operator=(BOOST_RV_REF(channel_receiver) other) {
+        if (this != &other) {
+            reset();
+            take_from(other);
+        }
+        return *this;
+    }
+
+    ~channel_receiver() { reset(); }
+
+    // Whether a value was received.
+    bool ready() const {
+        return state_.load(std::memory_order_acquire) == received;
+    }
+
+    // Blocks until the value is received or the sender goes away, and
+    // returns whether a value was received.
+    bool wait() const {
+        for (unsigned spins = 0; ; ++spins) {
+            unsigned char const state = state_.load(std::memory_order_acquire);
+            if (state != waiting)
+                return state == received;
+            if (spins >= 64)
+                std::this_thread::yield();
+        }
+    }
+
+    // Waits for the value and returns it. It is an error to call this if
+    // the sender went away without sending anything.
+    T& get() {
+        bool const received = wait();
+        BOOST_ASSERT(received);
+        (void)received;
+        return *static_cast<T*>(address());
+    }
+
+private:
+    BOOST_MOVABLE_BUT_NOT_COPYABLE(channel_receiver)
+
+    template <typename U>
+    friend struct channel;
+    friend struct channel_sender<T>;
+
+    enum { waiting, received, broken };
+
+    explicit channel_receiver(channel_end* sender)
+        : channel_end(sender), state_(waiting)
+    { }
+
+    void* address() { return static_cast<void*>(&storage_); }
+
+    // The sender only touches the state and the value while holding the
+    // locks of both ends, so they can be moved once other is locked.
+    void take_from(channel_receiver& other) {
+        channel_end* sender = other.lock_pair();
+        unsigned char const state =
+            other.state_.load(std::memory_order_relaxed);
+        if (state == received) {
+            T& value = *static_cast<T*>(other.address());
+            ::new (address()) T(boost::move(value));
+            value.~T();
+        }
+        state_.store(state, std::memory_order_relaxed);
+        other.state_.store(broken, std::memory_order_relaxed);
+        if (sender != NULL)
+            adopt(sender);
+        other.unlock(NULL);
+    }
+
+    void reset() {
+        channel_end* sender = unlink();
+        if (sender != NULL)
+            release(sender);
+        if (state_.load(std::memory_order_acquire) == received)
+            static_cast<T*>(address())->~T();
+        state_.store(broken, std::memory_order_relaxed);
+    }
+
+    typename boost::aligned_storage<
+        sizeof(T), boost::alignment_of<T>::value
+    >::type storage_;
+    std::atomic<unsigned char> state_;
+};
+
+/*!
+ * One-shot channel made of a sender and a receiver, to be moved out and
+ * handed to two threads, much like a `std::promise` and its `std::future`.
+ *
+ * There is no shared state: the value lives in the receiver, and the two
+ * ends keep track of each other when they are moved, which they can safely
+ * be while the other end is being used or moved by another thread. Each
+ * end may only be used by one thread at a time, though.
+ */
+template <typename T>
+struct channel {
+    typedef channel_sender<T> sender_type;
+    typedef channel_receiver<T> receiver_type;
+
+    sender_type sender;
+    receiver_type receiver;
+
+    channel()
+        : sender(&receiver), receiver(&sender)
+    { }
+
+private:
+    BOOST_MOVABLE_BUT_NOT_COPYABLE(channel)
+};
+
+template <typename T> class relocating_vector;
+
+/*!
+ * Member of an intrusive ring of handles to the same object, generalizing
+ * `sibling` to any number of members.
+ *
+ * Copying a handle adds a member to its group, and moving one takes its
+ * place in the group; both are O(1). When the object moves, whoever owns
+ * it retargets the whole group in one walk around the ring.
+ */
+template <typename T>
+struct handle {
+    handle() : prev_(this), next_(this), target_(NULL) { }
+
+    handle(handle const& other) : target_(other.target_) {
+        link_after(const_cast<handle&>(other));
+    }
+
+    handle(BOOST_RV_REF(handle) other) : target_(NULL) {
+        take_place_of(other);
+    }
+
+    handle& operator=(BOOST_COPY_ASSIGN_REF(handle) other) {
+        if (this != &other) {
+            unlink();
+            target_ = other.target_;
+            link_after(const_cast<handle&>(other));
+        }
+        return *this;
+    }
+
+    handle& operator=(BOOST_RV_REF(handle) other) {
+        if (this != &other) {
+            unlink();
+            take_place_of(other);
+        }
+        return *this;
+    }
+
+    ~handle() { unlink(); }
+
+    // The object referred to by the group, or NULL if it is gone.
+    T* get() const { return target_; }
+    T& operator*() const { BOOST_ASSERT(target_ != NULL); return *target_; }
+    T* operator->() const { BOOST_ASSERT(target_ != NULL); return target_; }
+
+    // Number of members in the group of *this, *this included; O(n).
+    std::size_t group_size() const {
+        std::size_t n = 1;
+        for (handle const* h = next_; h != this; h = h->next_)
+            ++n;
+        return n;
+    }
+
+    friend bool same_group(handle const& x, handle const& y) {
+        handle const* h = &x;
+        do {
+            if (h == &y)
+                return true;
+            h = h->next_;
+        } while (h != &x);
+        return false;
+    }
+
+    friend void swap(handle& x, handle& y) {
+        handle tmp(boost::move(x));
+        x = boost::move(y);
+        y = boost::move(tmp);
+    }
+
+private:
+    BOOST_COPYABLE_AND_MOVABLE(handle)
+
+    friend class relocating_vector<T>;
+
+    bool alone() const { return next_ == this; }
+
+    void link_after(handle& h) {
+        prev_ = &h;
+        next_ = h.next_;
+        h.next_->prev_ = this;
+        h.next_ = this;
+    }
+
+    void unlink() {
+        prev_->next_ = next_;
+        next_->prev_ = prev_;
+        prev_ = next_ = this;
+    }
+
+    // *this must be alone; other is left alone and without a target.
+    void take_place_of(handle& other) {
+        if (other.alone())
+            prev_ = next_ = this;
+        else {
+            prev_ = other.prev_;
+            next_ = other.next_;
+            prev_->next_ = this;
+            next_->prev_ = this;
+            other.prev_ = other.next_ = &other;
+        }
+        target_ = other.target_;
+        other.target_ = NULL;
+    }
+
+    // Makes every member of the group refer to target.
+    void retarget(T* target) {
+        handle* h = this;
+        do {
+            h->target_ = target;
+            h = h->next_;
+        } while (h != this);
+    }
+
+    handle* prev_;
+    handle* next_;
+    T* target_;
+};
+
+/*!
+ * Sequence of `T`s stored contiguously along with a `handle` for each of
+ * them. Handles obtained through `handle_to` keep referring to the same
+ * element when the storage is reallocated or when the element is moved by
+ * `erase`, and become empty when the element is destroyed.
+ */
+template <typename T>
+class relocating_vector {
+    struct slot {
+        T value;
+        handle<T> anchor;
+
+        explicit slot(T const& v) : value(v) { anchor.target_ = &value; }
+        explicit slot(BOOST_RV_REF(T) v) : value(boost::move(v)) {
+            anchor.target_ = &value;
+        }
+
+        // Relocation: the group of other follows the value.
+        slot(BOOST_RV_REF(slot) other)
+            : value(boost::move(other.value)), anchor(boost::move(other.anchor))
+        {
+            anchor.retarget(&value);
+        }
+
+        slot& operator=(BOOST_RV_REF(slot) other) {
+            anchor.retarget(NULL);
+            value = boost::move(other.value);
+            anchor = boost::move(other.anchor);
+            anchor.retarget(&value);
+            return *this;
+        }
+
+        ~slot() { anchor.retarget(NULL); }
+
+    private:
+        BOOST_MOVABLE_BUT_NOT_COPYABLE(slot)
+    };
+
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef handle<T> handle_type;
+
+    relocating_vector() : slots_(NULL), size_(0), capacity_(0) { }
+
+    ~relocating_vector() {
+        clear();
+        ::operator delete(slots_);
+    }
+
+    size_type size() const { return size_; }
+    size_type capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    T& operator[](size_type i) {
+        BOOST_ASSERT(i < size_);
+        return slots_[i].value;
+    }
+
+    T const& operator[](size_type i) const {
+        BOOST_ASSERT(i < size_);
+        return slots_[i].value;
+    }
+
+    // Returns a new member of the group of the i-th element.
+    handle_type handle_to(size_type i) {
+        BOOST_ASSERT(i < size_);
+        return handle_type(slots_[i].anchor);
+    }
+
+    void push_back(T const& value) {
+        if (size_ == capacity_)
+            reserve(capacity_ == 0 ? 8 : capacity_ * 2);
+        ::new (&slots_[size_]) slot(value);
+        ++size_;
+    }
+
+    void push_back(BOOST_RV_REF(T) value) {
+        if (size_ == capacity_)
+            reserve(capacity_ == 0 ? 8 : capacity_ * 2);
+        ::new (&slots_[size_]) slot(boost::move(value));
+        ++size_;
+    }
+
+    void pop_back() {
+        BOOST_ASSERT(!empty());
+        slots_[--size_].~slot();
+    }
+
+    // Replaces the i-th element with the last one, whose handles follow it.
+    void erase(size_type i) {
+        BOOST_ASSERT(i < size_);
+        if (i != size_ - 1)
+            slots_[i] = boost::move(slots_[size_ - 1]);
+        pop_back();
+    }
+
+    void clear() {
+        while (!empty())
+            pop_back();
+    }
+
+    // Moves the elements to new storage; every group is retargeted while
+    // its element is moved, in the same pass.
+    void reserve(size_type n) {
+        if (n <= capacity_)
+            return;
+        slot* slots = static_cast<slot*>(::operator new(n * sizeof(slot)));
+        for (size_type i = 0; i < size_; ++i) {
+            ::new (&slots[i]) slot(boost::move(slots_[i]));
+            slots_[i].~slot();
+        }
+        ::operator delete(slots_);
+        slots_ = slots;
+        capacity_ = n;
+    }
+
+private:
+    relocating_vector(relocating_vector const&);
+    relocating_vector& operator=(relocating_vector const&);
+
+    slot* slots_;
+    size_type size_;
+    size_type capacity_;
+};
 } // end namespace sandbox
 
 #endif // !LDIONNE_SANDBOX_SIBLING_HPP
 
 
 #include <boost/assert.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <new>
+#include <vector>
 
 
-// g++-4.8 -std=c++11 -Wall -Wextra -pedantic -I /usr/local/include -o sibling sibling.cpp -O0
+// g++-4.8 -std=c++11 -Wall -Wextra -pedantic -pthread -I /usr/local/include -o sibling sibling.cpp -O0
 
 typedef sandbox::siblings<int> Siblings;
 typedef Siblings::sibling_type Sibling;
@@ -200,6 +770,295 @@ void swapping_unrelated_siblings_works_as_expected() {
     BOOST_ASSERT(are_siblings(c, b));
 }
 
+typedef sandbox::channel<int> Channel;
+typedef Channel::sender_type Sender;
+typedef Channel::receiver_type Receiver;
+
+void channel_delivers_value() {
+    Channel channel;
+    Sender s = boost::move(channel.sender);
+    Receiver r = boost::move(channel.receiver);
+    BOOST_ASSERT(!r.ready());
+    bool const sent = s.set_value(3);
+    BOOST_ASSERT(sent);
+    (void)sent;
+    BOOST_ASSERT(!s.has_receiver());
+    BOOST_ASSERT(r.ready());
+    BOOST_ASSERT(r.get() == 3);
+}
+
+void channel_breaks_when_sender_dies() {
+    Channel channel;
+    Receiver r = boost::move(channel.receiver);
+    {
+        Sender s = boost::move(channel.sender);
+    }
+    BOOST_ASSERT(!r.wait());
+}
+
+void channel_refuses_value_when_receiver_dies() {
+    Channel channel;
+    Sender s = boost::move(channel.sender);
+    {
+        Receiver r = boost::move(channel.receiver);
+    }
+    BOOST_ASSERT(!s.has_receiver());
+    bool const sent = s.set_value(3);
+    BOOST_ASSERT(!sent);
+    (void)sent;
+}
+
+struct throws_on_copy {
+    explicit throws_on_copy(bool fail) : fail(fail) { }
+    throws_on_copy(throws_on_copy const& other) : fail(other.fail) {
+        if (fail)
+            throw fail;
+    }
+    bool fail;
+};
+
+void channel_survives_throwing_value() {
+    sandbox::channel<throws_on_copy> channel;
+    sandbox::channel_sender<throws_on_copy> s = boost::move(channel.sender);
+    sandbox::channel_receiver<throws_on_copy> r = boost::move(channel.receiver);
+    bool threw = false;
+    try {
+        s.set_value(throws_on_copy(true));
+    }
+    catch (bool) {
+        threw = true;
+    }
+    BOOST_ASSERT(threw);
+    BOOST_ASSERT(s.has_receiver());
+    BOOST_ASSERT(!r.ready());
+    bool const sent = s.set_value(throws_on_copy(false));
+    BOOST_ASSERT(sent);
+    BOOST_ASSERT(!r.get().fail);
+    (void)threw;
+    (void)sent;
+}
+
+void channel_value_follows_moved_receiver() {
+    Channel channel;
+    Sender s = boost::move(channel.sender);
+    Receiver r = boost::move(channel.receiver);
+    s.set_value(3);
+    Receiver r2 = boost::move(r);
+    BOOST_ASSERT(!r.wait());
+    BOOST_ASSERT(r2.get() == 3);
+}
+
+void channel_ends_move_concurrently() {
+    for (int i = 0; i < 1000; ++i) {
+        Channel channel;
+        Sender s = boost::move(channel.sender);
+        Receiver r = boost::move(channel.receiver);
+
+        std::thread sender([&s, i] {
+            Sender moved[4] = {
+                boost::move(s), boost::move(moved[0]),
+                boost::move(moved[1]), boost::move(moved[2])
+            };
+            bool const sent = moved[3].set_value(i);
+            BOOST_ASSERT(sent);
+            (void)sent;
+        });
+        Receiver moved[4] = {
+            boost::move(r), boost::move(moved[0]),
+            boost::move(moved[1]), boost::move(moved[2])
+        };
+        int const received = moved[3].get();
+        BOOST_ASSERT(received == i);
+        (void)received;
+        sender.join();
+    }
+}
+
+typedef sandbox::handle<int> Handle;
+typedef sandbox::relocating_vector<int> RelocatingVector;
+
+void copied_handles_join_the_group() {
+    RelocatingVector v;
+    v.push_back(1);
+    Handle a = v.handle_to(0);
+    Handle b = a;
+    Handle c;
+    c = b;
+    BOOST_ASSERT(a.group_size() == 4);
+    BOOST_ASSERT(same_group(a, c));
+    BOOST_ASSERT(*c == 1);
+}
+
+void moved_handles_take_the_place_of_the_source() {
+    RelocatingVector v;
+    v.push_back(1);
+    Handle a = v.handle_to(0);
+    Handle b = boost::move(a);
+    BOOST_ASSERT(a.get() == NULL);
+    BOOST_ASSERT(a.group_size() == 1);
+    BOOST_ASSERT(b.group_size() == 2);
+    BOOST_ASSERT(*b == 1);
+}
+
+void handles_survive_reallocation() {
+    RelocatingVector v;
+    std::vector<Handle> handles;
+    for (int i = 0; i < 100; ++i) {
+        v.push_back(i);
+        handles.push_back(v.handle_to(i));
+    }
+    BOOST_ASSERT(v.capacity() > 8);
+    for (int i = 0; i < 100; ++i)
+        BOOST_ASSERT(handles[i].get() == &v[i]);
+}
+
+void handles_follow_erased_elements() {
+    RelocatingVector v;
+    v.push_back(0);
+    v.push_back(1);
+    v.push_back(2);
+    Handle zero = v.handle_to(0);
+    Handle two = v.handle_to(2);
+
+    v.erase(0);
+    BOOST_ASSERT(zero.get() == NULL);
+    BOOST_ASSERT(two.get() == &v[0]);
+    BOOST_ASSERT(*two == 2);
+
+    v.clear();
+    BOOST_ASSERT(two.get() == NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Benchmarks; the timings only mean something when built with -O2.
+//////////////////////////////////////////////////////////////////////////
+std::atomic<std::size_t> allocations(0);
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+template <typename F>
+void measure(char const* name, std::size_t iterations, F f) {
+    std::size_t const allocated = allocations;
+    auto const start = std::chrono::steady_clock::now();
+    long long const sum = f(iterations);
+    std::chrono::duration<double, std::nano> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::printf("%-32s %7.1f ns, %.2f allocations per round (sum %lld)\n",
+                name, elapsed.count() / iterations,
+                double(allocations - allocated) / iterations, sum);
+}
+
+// Rounds of creating a channel, sending a value and receiving it in the
+// same thread, then rounds of sending a value to another thread and getting
+// it back on a second channel, against std::promise and std::future. The
+// time and allocations of a round include creating its channels.
+void benchmark_channel() {
+    std::size_t const local = 1000000, remote = 100000;
+
+    measure("channel, same thread", local, [](std::size_t n) {
+        long long sum = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            Channel channel;
+            channel.sender.set_value(static_cast<int>(i));
+            sum += channel.receiver.get();
+        }
+        return sum;
+    });
+    measure("promise/future, same thread", local, [](std::size_t n) {
+        long long sum = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            std::promise<int> promise;
+            std::future<int> future = promise.get_future();
+            promise.set_value(static_cast<int>(i));
+            sum += future.get();
+        }
+        return sum;
+    });
+
+    measure("channel, round trip", remote, [](std::size_t n) {
+        std::vector<Channel> pings(n), pongs(n);
+        std::thread echo([&] {
+            for (std::size_t i = 0; i < n; ++i)
+                pongs[i].sender.set_value(pings[i].receiver.get() + 1);
+        });
+        long long sum = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            pings[i].sender.set_value(static_cast<int>(i));
+            sum += pongs[i].receiver.get();
+        }
+        echo.join();
+        return sum;
+    });
+    measure("promise/future, round trip", remote, [](std::size_t n) {
+        std::vector<std::promise<int> > pings(n), pongs(n);
+        std::vector<std::future<int> > ping_futures, pong_futures;
+        for (std::size_t i = 0; i < n; ++i) {
+            ping_futures.push_back(pings[i].get_future());
+            pong_futures.push_back(pongs[i].get_future());
+        }
+        std::thread echo([&] {
+            for (std::size_t i = 0; i < n; ++i)
+                pongs[i].set_value(ping_futures[i].get() + 1);
+        });
+        long long sum = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            pings[i].set_value(static_cast<int>(i));
+            sum += pong_futures[i].get();
+        }
+        echo.join();
+        return sum;
+    });
+}
+
+// Back-references to a million elements, taken as they are appended, then
+// followed: handles into a relocating_vector, against elements held by
+// shared_ptr and referred to by weak_ptr, which like handles become empty
+// when the element goes away.
+void benchmark_handles() {
+    std::size_t const n = 1000000;
+
+    RelocatingVector v;
+    std::vector<Handle> handles;
+    handles.reserve(n);
+    measure("relocating_vector, append", n, [&](std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            v.push_back(static_cast<int>(i));
+            handles.push_back(v.handle_to(i));
+        }
+        return static_cast<long long>(v.size());
+    });
+    measure("relocating_vector, follow", n, [&](std::size_t count) {
+        long long sum = 0;
+        for (std::size_t i = 0; i < count; ++i)
+            sum += *handles[i];
+        return sum;
+    });
+
+    std::vector<std::shared_ptr<int> > elements;
+    std::vector<std::weak_ptr<int> > references;
+    references.reserve(n);
+    measure("shared_ptr, append", n, [&](std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            elements.push_back(std::make_shared<int>(static_cast<int>(i)));
+            references.push_back(elements.back());
+        }
+        return static_cast<long long>(elements.size());
+    });
+    measure("shared_ptr, follow", n, [&](std::size_t count) {
+        long long sum = 0;
+        for (std::size_t i = 0; i < count; ++i)
+            sum += *references[i].lock();
+        return sum;
+    });
+}
+
 int main() {
     simple_construction();
     self_assign_is_noop();
@@ -207,4 +1066,16 @@ int main() {
     killing_sibling_empties_both();
     swapping_related_siblings_is_noop();
     swapping_unrelated_siblings_works_as_expected();
+    channel_delivers_value();
+    channel_breaks_when_sender_dies();
+    channel_refuses_value_when_receiver_dies();
+    channel_survives_throwing_value();
+    channel_value_follows_moved_receiver();
+    channel_ends_move_concurrently();
+    copied_handles_join_the_group();
+    moved_handles_take_the_place_of_the_source();
+    handles_survive_reallocation();
+    handles_follow_erased_elements();
+    benchmark_channel();
+    benchmark_handles();
 }
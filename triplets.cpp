@@ -1,22 +1,501 @@
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <new>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include <sys/mman.h>
+#include <unistd.h>
 
-// g++-4.8 -std=c++11 -Wall -Wextra -pedantic -o triplets triplets.cpp
 
-int main() {
-    unsigned long N = 0;
-    std::cin >> N;
+// g++-4.8 -std=c++11 -Wall -Wextra -pedantic -O2 -pthread -o triplets triplets.cpp
+//
+// Usage:
+//  triplets [--debug | --sort [--threads=n] | --approximate[=error]] < input
+// where input is the number of values followed by the values themselves.
+// The distinct values are counted on the fly with a hash set by default.
+// With --sort, they are loaded and counted with a parallel radix sort.
+// With --approximate, their number is estimated in constant memory, with
+// the given relative standard error (0.01 by default), and the estimated
+// count of triplets is printed with a 95% confidence interval.
+// With --debug, they are loaded, sorted and uniqued in memory and dumped to
+// stderr at each step.
 
-    // If the sequence does not hold enough values for a single triplet,
-    // handle it right now.
+// Reads the unsigned integers of a file descriptor, skipping anything else.
+// The input goes through a fixed size buffer, so it is never held in memory
+// as a whole.
+class integer_reader {
+public:
+    explicit integer_reader(int fd)
+        : fd_(fd), buffer_(buffer_size), p_(NULL), end_(NULL)
+    { }
+
+    bool next(unsigned long& value) {
+        for (;;) {
+            if (p_ == end_ && !refill())
+                return false;
+            if (is_digit(*p_))
+                break;
+            ++p_;
+        }
+
+        // A number may straddle two reads, so the end of the buffer is
+        // checked for each digit.
+        unsigned long v = 0;
+        do {
+            v = v * 10 + static_cast<unsigned long>(*p_++ - '0');
+        } while ((p_ != end_ || refill()) && is_digit(*p_));
+        value = v;
+        return true;
+    }
+
+private:
+    integer_reader(integer_reader const&);
+    integer_reader& operator=(integer_reader const&);
+
+    static std::size_t const buffer_size = 1 << 20;
+
+    static bool is_digit(char c) {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    bool refill() {
+        ssize_t n;
+        do
+            n = ::read(fd_, buffer_.data(), buffer_.size());
+        while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            return false;
+        p_ = buffer_.data();
+        end_ = p_ + n;
+        return true;
+    }
+
+    int fd_;
+    std::vector<char> buffer_;
+    char const* p_;
+    char const* end_;
+};
+
+// The leading count of the input is only trusted up to this many values
+// when sizing things up front; past it, they grow as the values come.
+// Untouched pages are not committed, so a wrong count below this bound
+// mostly costs address space.
+unsigned long const max_presized = 1ul << 26;
+
+// Open addressing hash set of integers that only counts its elements.
+//
+// Once the table is larger than the caches, inserting a value anywhere in
+// it is both a cache and a TLB miss. Values are thus first put in buckets
+// according to the top bits of their hash, which also select the region of
+// the table where they belong, and a bucket is inserted at once when it is
+// full, only touching that region, with the slots of its values prefetched
+// a few at a time.
+class distinct_set {
+public:
+    explicit distinct_set(std::size_t expected)
+        : pending_(buckets * bucket_size), fill_(buckets, 0),
+          has_zero_(false), size_(0)
+    {
+        std::size_t capacity = 16;
+        expected = std::min<std::size_t>(expected, max_presized);
+        while (capacity / 4 * 3 < expected)
+            capacity *= 2;
+        rehash(capacity);
+    }
+
+    void insert(unsigned long value) {
+        std::size_t const b = hash(value) >> (64 - bucket_bits);
+        pending_[b * bucket_size + fill_[b]] = value;
+        if (++fill_[b] == bucket_size)
+            flush(b);
+    }
+
+    // Number of distinct values inserted so far.
+    std::size_t count() {
+        for (std::size_t b = 0; b != buckets; ++b)
+            flush(b);
+        return size_;
+    }
+
+private:
+    static unsigned const bucket_bits = 10;
+    static std::size_t const buckets = std::size_t(1) << bucket_bits;
+    static std::size_t const bucket_size = 256;
+    static std::size_t const prefetch_distance = 16;
+
+    static unsigned long long hash(unsigned long value) {
+        return static_cast<unsigned long long>(value) * 0x9E3779B97F4A7C15ull;
+    }
+
+    std::size_t slot(unsigned long value) const {
+        return static_cast<std::size_t>(hash(value) >> shift_);
+    }
+
+    void flush(std::size_t b) {
+        std::size_t const n = fill_[b];
+        fill_[b] = 0;
+        while (size_ + n > limit_)
+            rehash(2 * slots_.size());
+
+        unsigned long const* values = &pending_[b * bucket_size];
+        std::size_t where[prefetch_distance];
+        for (std::size_t i = 0; i < n && i < prefetch_distance; ++i) {
+            where[i] = slot(values[i]);
+            __builtin_prefetch(&slots_[where[i]]);
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t const at = where[i % prefetch_distance];
+            if (i + prefetch_distance < n) {
+                std::size_t& next = where[i % prefetch_distance];
+                next = slot(values[i + prefetch_distance]);
+                __builtin_prefetch(&slots_[next]);
+            }
+            insert(values[i], at);
+        }
+    }
+
+    // 0 marks an empty slot, so it is tracked on the side.
+    void insert(unsigned long value, std::size_t i) {
+        if (value == 0) {
+            size_ += !has_zero_;
+            has_zero_ = true;
+            return;
+        }
+        std::size_t const mask = slots_.size() - 1;
+        for (; slots_[i] != 0; i = (i + 1) & mask)
+            if (slots_[i] == value)
+                return;
+        slots_[i] = value;
+        ++size_;
+    }
+
+    void rehash(std::size_t capacity) {
+        table old(capacity);
+        old.swap(slots_);
+        shift_ = 64;
+        for (std::size_t c = capacity; c > 1; c /= 2)
+            --shift_;
+        limit_ = capacity / 4 * 3;
+        size_ = has_zero_;
+        for (std::size_t i = 0; i < old.size(); ++i)
+            if (old[i] != 0)
+                insert(old[i], slot(old[i]));
+    }
+
+    // Zeroed memory straight from mmap, asking for huge pages to make the
+    // TLB misses rarer.
+    class table {
+    public:
+        explicit table(std::size_t size = 0) : data_(NULL), size_(size) {
+            if (size == 0)
+                return;
+            void* p = ::mmap(NULL, bytes(), PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+            ::madvise(p, bytes(), MADV_HUGEPAGE);
+#endif
+            data_ = static_cast<unsigned long*>(p);
+        }
+
+        ~table() {
+            if (data_ != NULL)
+                ::munmap(data_, bytes());
+        }
+
+        void swap(table& other) {
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+        }
+
+        unsigned long& operator[](std::size_t i) { return data_[i]; }
+        unsigned long operator[](std::size_t i) const { return data_[i]; }
+        std::size_t size() const { return size_; }
+
+    private:
+        table(table const&);
+        table& operator=(table const&);
+
+        std::size_t bytes() const { return size_ * sizeof(unsigned long); }
+
+        unsigned long* data_;
+        std::size_t size_;
+    };
+
+    table slots_;
+    unsigned shift_;
+    std::size_t limit_;
+    std::vector<unsigned long> pending_;
+    std::vector<std::size_t> fill_;
+    bool has_zero_;
+    std::size_t size_;
+};
+
+// Counts the distinct values of a sequence with a radix sort, reordering
+// the values in place, using up to `threads` threads.
+//
+// The values are first partitioned by their most significant byte, each
+// thread counting and then scattering a slice of the input. The partitions
+// are then handed out to the threads, which sort each of them by the bytes
+// below, least significant first, except for the lowest byte: values that
+// only differ by their lowest byte end up next to each other, and their
+// number of distinct values is the number of bits set in a 256-bit mask of
+// those lowest bytes. The deduplication thus replaces the last scatter with
+// a sequential scan.
+namespace radix_detail {
+    typedef std::size_t histogram[256];
+
+    inline unsigned digit(unsigned long v, unsigned shift) {
+        return static_cast<unsigned>(v >> shift) & 0xFF;
+    }
+
+    // Number of distinct values in [first, last), where values that only
+    // differ by their lowest byte are next to each other.
+    inline std::size_t count_runs(unsigned long const* first,
+                                  unsigned long const* last) {
+        std::size_t count = 0;
+        while (first != last) {
+            unsigned long const high = *first >> 8;
+            std::uint64_t seen[4] = { 0, 0, 0, 0 };
+            for (; first != last && *first >> 8 == high; ++first)
+                seen[(*first >> 6) & 3] |= std::uint64_t(1) << (*first & 63);
+            for (int i = 0; i != 4; ++i)
+                count += __builtin_popcountll(seen[i]);
+        }
+        return count;
+    }
+
+    // Sorts [first, last) by bytes 1 to `bytes` - 2, using [scratch, ...)
+    // as a buffer of the same size, and counts its distinct values.
+    inline std::size_t sort_partition(unsigned long* first, unsigned long* last,
+                                      unsigned long* scratch, unsigned bytes) {
+        std::size_t const n = last - first;
+        unsigned long* from = first;
+        unsigned long* to = scratch;
+        for (unsigned byte = 1; byte + 1 < bytes; ++byte) {
+            unsigned const shift = 8 * byte;
+            histogram counts = {};
+            for (std::size_t i = 0; i != n; ++i)
+                ++counts[digit(from[i], shift)];
+            // Nothing to do if all the values have the same digit.
+            if (counts[digit(from[0], shift)] == n)
+                continue;
+            std::size_t offset = 0;
+            for (int d = 0; d != 256; ++d) {
+                std::size_t const c = counts[d];
+                counts[d] = offset;
+                offset += c;
+            }
+            for (std::size_t i = 0; i != n; ++i)
+                to[counts[digit(from[i], shift)]++] = from[i];
+            std::swap(from, to);
+        }
+        return count_runs(from, from + n);
+    }
+
+    template <typename F>
+    void parallel(unsigned threads, F f) {
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t)
+            workers.push_back(std::thread(f, t));
+        f(0);
+        for (unsigned t = 0; t + 1 < threads; ++t)
+            workers[t].join();
+    }
+} // end namespace radix_detail
+
+inline std::size_t count_distinct_radix(std::vector<unsigned long>& values,
+                                        unsigned threads) {
+    using namespace radix_detail;
+    std::size_t const n = values.size();
+    if (n == 0)
+        return 0;
+    threads = std::max(1u, std::min<unsigned>(threads, (n + 65535) / 65536));
+
+    unsigned long const max = *std::max_element(values.begin(), values.end());
+    unsigned bytes = 1;
+    while (bytes < sizeof(unsigned long) && (max >> (8 * bytes)) != 0)
+        ++bytes;
+    if (bytes == 1)
+        return count_runs(values.data(), values.data() + n);
+
+    // Partition by the top byte, each thread handling a slice.
+    unsigned const top = 8 * (bytes - 1);
+    std::vector<unsigned long> scratch(n);
+    std::vector<std::size_t> counts(threads * 256);
+    std::size_t const slice = (n + threads - 1) / threads;
+    unsigned long const* in = values.data();
+    parallel(threads, [&](unsigned t) {
+        std::size_t* c = &counts[t * 256];
+        for (std::size_t i = t * slice; i < std::min(n, (t + 1) * slice); ++i)
+            ++c[digit(in[i], top)];
+    });
+    std::vector<std::size_t> partitions(257);
+    std::size_t offset = 0;
+    for (int d = 0; d != 256; ++d) {
+        partitions[d] = offset;
+        for (unsigned t = 0; t != threads; ++t) {
+            std::size_t const c = counts[t * 256 + d];
+            counts[t * 256 + d] = offset;
+            offset += c;
+        }
+    }
+    partitions[256] = n;
+    unsigned long* out = scratch.data();
+    parallel(threads, [&](unsigned t) {
+        std::size_t* c = &counts[t * 256];
+        for (std::size_t i = t * slice; i < std::min(n, (t + 1) * slice); ++i)
+            out[c[digit(in[i], top)]++] = in[i];
+    });
+
+    // Sort and count the partitions, largest first so the threads finish
+    // at about the same time.
+    std::vector<int> order(256);
+    for (int d = 0; d != 256; ++d)
+        order[d] = d;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return partitions[a + 1] - partitions[a] >
+               partitions[b + 1] - partitions[b];
+    });
+    std::atomic<int> next(0);
+    std::vector<std::size_t> distinct(threads, 0);
+    parallel(threads, [&](unsigned t) {
+        for (int i; (i = next.fetch_add(1)) < 256; ) {
+            std::size_t const b = partitions[order[i]];
+            std::size_t const e = partitions[order[i] + 1];
+            if (b != e)
+                distinct[t] += sort_partition(out + b, out + e,
+                                              values.data() + b, bytes);
+        }
+    });
+    std::size_t total = 0;
+    for (unsigned t = 0; t != threads; ++t)
+        total += distinct[t];
+    return total;
+}
+
+// HyperLogLog sketch (Flajolet, Fusy, Gandouet and Meunier) estimating the
+// number of distinct values of a stream in 2^precision bytes, with a
+// relative standard error of about 1.04 / sqrt(2^precision).
+class distinct_estimator {
+public:
+    explicit distinct_estimator(unsigned precision)
+        : precision_(std::min(std::max(precision, min_precision),
+                              max_precision)),
+          registers_(std::size_t(1) << precision_, 0)
+    { }
+
+    // Smallest precision whose standard error is at most `error`.
+    static unsigned precision_for(double error) {
+        unsigned p = min_precision;
+        while (p < max_precision && standard_error(p) > error)
+            ++p;
+        return p;
+    }
+
+    void insert(unsigned long value) {
+        std::uint64_t const h = mix(value);
+        std::size_t const r = static_cast<std::size_t>(h >> (64 - precision_));
+        // The rank is the position of the first 1 in the remaining bits,
+        // which the sentinel bit keeps below 64 - precision + 2.
+        std::uint64_t const rest =
+            (h << precision_) | (std::uint64_t(1) << (precision_ - 1));
+        unsigned char const rank =
+            static_cast<unsigned char>(__builtin_clzll(rest) + 1);
+        if (rank > registers_[r])
+            registers_[r] = rank;
+    }
+
+    double estimate() const {
+        double const m = static_cast<double>(registers_.size());
+        double sum = 0;
+        std::size_t zeros = 0;
+        for (std::size_t i = 0; i < registers_.size(); ++i) {
+            sum += std::ldexp(1.0, -registers_[i]);
+            zeros += registers_[i] == 0;
+        }
+        double const alpha = m == 16 ? 0.673 : m == 32 ? 0.697 :
+                             m == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m);
+        double const raw = alpha * m * m / sum;
+        // Small cardinalities are better estimated by linear counting. The
+        // hash has 64 bits, so no correction is needed for large ones.
+        if (raw <= 2.5 * m && zeros != 0)
+            return m * std::log(m / static_cast<double>(zeros));
+        return raw;
+    }
+
+    double standard_error() const { return standard_error(precision_); }
+    std::size_t memory() const { return registers_.size(); }
+
+private:
+    static unsigned const min_precision = 4;
+    static unsigned const max_precision = 24;
+
+    static double standard_error(unsigned precision) {
+        return 1.04 / std::sqrt(std::ldexp(1.0, precision));
+    }
+
+    // Finalizer of splitmix64, so that close values get unrelated hashes.
+    static std::uint64_t mix(std::uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    unsigned precision_;
+    std::vector<unsigned char> registers_;
+};
+
+// std::min and std::max take these by reference.
+unsigned const distinct_estimator::min_precision;
+unsigned const distinct_estimator::max_precision;
+
+__extension__ typedef unsigned __int128 uint128;
+
+// Now, we observe that we only need to compute:
+// sum from i=2 to N-1 of (i-1)*(N-i)
+// after some mathematical simplification, we end up with
+// the following formula:
+// (1/6)N(N^2 - 3N + 2) = (N((N-3)N + 2)) / 6
+// (you can paste the sum in wolfram to get the simplification)
+//
+// N^3 overflows 64 bits as soon as N reaches 2^21, so this is computed on
+// 128 bits, as N(N-1)(N-2) / 6 with the divisions done first, which is
+// exact for N below 2^43.
+uint128 count_triplets(unsigned long long N) {
     if (N < 3)
-        std::cout << 0;
+        return 0;
+    uint128 a = N, b = N - 1, c = N - 2;
+    (a % 2 == 0 ? a : b) /= 2;
+    (a % 3 == 0 ? a : b % 3 == 0 ? b : c) /= 3;
+    return a * b * c;
+}
 
+std::string to_string(uint128 x) {
+    char digits[40];
+    char* p = digits + sizeof digits;
+    do {
+        *--p = static_cast<char>('0' + static_cast<int>(x % 10));
+        x /= 10;
+    } while (x != 0);
+    return std::string(p, digits + sizeof digits);
+}
+
+// The original implementation, kept as the debug mode.
+unsigned long count_distinct_debug(unsigned long N) {
     // Load the sequence of integers.
     // Note: We could insert them in a sorted and uniqued fashion to save
     //       much work later on. We could use a set, but it would be
@@ -43,17 +522,109 @@ int main() {
     std::copy(d.begin(), d.end(), std::ostream_iterator<unsigned long>(std::cerr, " "));
     std::cerr << '\n';
 
-    // N will now be the length of the 'cleaned up' sequence.
-    N = d.size();
-
-    // Now, we observe that we only need to compute:
-    // sum from i=2 to N-1 of (i-1)*(N-i)
-    // after some mathematical simplification, we end up with
-    // the following formula:
-    // (1/6)N(N^2 - 3N + 2) = (N((N-3)N + 2)) / 6
-    // (you can paste the sum in wolfram to get the simplification)
-    unsigned long const triplets = (N * ((N - 3) * N + 2)) / 6;
-    std::cout << triplets;
+    return d.size();
+}
+
+// Streams the values straight from the input into a distinct_set.
+unsigned long count_distinct(integer_reader& in, unsigned long N) {
+    distinct_set distinct(N);
+    unsigned long value, count = 0;
+    for (; in.next(value); ++count)
+        distinct.insert(value);
+    assert(N == count);
+    (void)count;
+    return distinct.count();
+}
+
+// Streams the values into a distinct_estimator. The leading count is not
+// checked, since the stream may not end when expected.
+distinct_estimator estimate_distinct(integer_reader& in, double error) {
+    distinct_estimator estimator(distinct_estimator::precision_for(error));
+    unsigned long value;
+    while (in.next(value))
+        estimator.insert(value);
+    return estimator;
+}
+
+// Loads the values and counts them with count_distinct_radix.
+unsigned long count_distinct_sorted(integer_reader& in, unsigned long N,
+                                    unsigned threads) {
+    std::vector<unsigned long> values;
+    values.reserve(std::min(N, max_presized));
+    unsigned long value;
+    while (in.next(value))
+        values.push_back(value);
+    assert(N == values.size());
+    return count_distinct_radix(values, threads);
+}
+
+int main(int argc, char* argv[]) {
+    bool debug = false, sort = false, approximate = false;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    double error = 0.01;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--debug") == 0)
+            debug = true;
+        else if (std::strcmp(argv[i], "--sort") == 0)
+            sort = true;
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0)
+            threads = std::max(1, std::atoi(argv[i] + 10));
+        else if (std::strcmp(argv[i], "--approximate") == 0)
+            approximate = true;
+        else if (std::strncmp(argv[i], "--approximate=", 14) == 0) {
+            approximate = true;
+            error = std::atof(argv[i] + 14);
+        }
+    }
+
+    unsigned long N = 0;
+    if (approximate) {
+        integer_reader in(STDIN_FILENO);
+        in.next(N);
+        if (N < 3) {
+            std::cout << 0;
+            return 0;
+        }
+
+        // The estimate is within 1.96 standard errors of N 95% of the time.
+        distinct_estimator const estimator = estimate_distinct(in, error);
+        double const estimate = estimator.estimate();
+        double const margin = 1.96 * estimator.standard_error() * estimate;
+        std::cout << to_string(count_triplets(std::llround(estimate)))
+                  << " [" << to_string(count_triplets(
+                                std::llround(std::max(0.0, estimate - margin))))
+                  << ", " << to_string(count_triplets(
+                                std::llround(estimate + margin)))
+                  << "]";
+        return 0;
+    }
+    else if (debug) {
+        std::cin >> N;
+        if (N >= 3)
+            N = count_distinct_debug(N);
+    }
+    else if (sort) {
+        integer_reader in(STDIN_FILENO);
+        in.next(N);
+        if (N >= 3)
+            N = count_distinct_sorted(in, N, threads);
+    }
+    else {
+        integer_reader in(STDIN_FILENO);
+        in.next(N);
+        if (N >= 3)
+            N = count_distinct(in, N);
+    }
+
+    // If the sequence does not hold enough values for a single triplet,
+    // handle it right now.
+    if (N < 3) {
+        std::cout << 0;
+        return 0;
+    }
+
+    // N is now the length of the 'cleaned up' sequence.
+    std::cout << to_string(count_triplets(N));
 
     // std::vector<unsigned long>::const_iterator i, last = d.end();
     // unsigned long triplets = 0;